@@ -0,0 +1,197 @@
+/**
+ * @file benchmark.ino
+ * @author CostelloTechnical
+ *
+ * @brief This code benchmarks the library on the board it runs on and prints
+ * the results as CSV to the Serial monitor, so runs can be saved and compared:
+ *
+ *     board,test,mode,channels,frequency_Hz,exact,cpu_pct,maxLatency_cycles,missed
+ *
+ * test is "rate" for the highest DISCRETE frequency every channel sustains,
+ * as the timers ran it, together (binary search), or "sweep" for a fixed grid
+ * of frequencies.
+ *
+ * A DISCRETE train counts as exact if it finishes within 2% of its ideal
+ * duration. An interrupt that comes too late loses a toggle from the count,
+ * so the train runs on past its last pulse. cpu_pct is the share of loop()
+ * time taken by the library's interrupts, from how fast a busy loop runs while
+ * the trains run compared with an idle baseline.
+ *
+ * maxLatency_cycles and missed are filled in only when the library is built
+ * with PTO_ENABLE_STATISTICS set to 1 (see pulseTrainOutput.h). maxLatency is
+ * the worst time from a compare match to its interrupt over all channels, so
+ * the edge jitter the interrupt adds. missed counts matches that were never
+ * handled.
+ *
+ * Nothing needs wiring. All channels start together through a pulseTrainGroup.
+ *
+ * For a complete list of compatable pins for a given microcontroller, see the README file.
+ * @see https://github.com/CostelloTechnical/pulseTrainOutput/blob/main/README.md
+ * @date 2026-10-17
+*/
+
+#include "pulseTrainOutput.h"
+
+// One pin per timer.
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+const char board[] = "R4";
+pulseTrainOutput ch0(5), ch1(3), ch2(6), ch3(8);    // GPT0, GPT1, GPT3 and GPT7.
+pulseTrainOutput* channels[] = {&ch0, &ch1, &ch2, &ch3};
+const uint32_t rateLimit = 1000000;
+#elif defined(__AVR_ATmega2560__)
+const char board[] = "Mega";
+pulseTrainOutput ch0(11), ch1(10), ch2(5), ch3(6), ch4(46);
+pulseTrainOutput* channels[] = {&ch0, &ch1, &ch2, &ch3, &ch4};
+const uint32_t rateLimit = 400000;
+#else
+const char board[] = "Uno";
+pulseTrainOutput ch0(9), ch1(11);
+pulseTrainOutput* channels[] = {&ch0, &ch1};
+const uint32_t rateLimit = 400000;
+#endif
+
+const uint8_t channelCount = sizeof(channels) / sizeof(channels[0]);
+const uint32_t sweepFrequencies[] = {1000, 10000, 25000, 50000, 100000};
+const uint32_t window_us = 50000;  // How long the busy loop is timed. Every train outlasts it.
+
+uint32_t baselinePasses;           // Busy loop passes in one window with nothing running.
+volatile bool sink;                // Keeps the busy loop's work from being optimised away.
+
+bool anyRunning(uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (channels[i]->isRunning()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Counts busy loop passes for one window. The loop does the same work whether or not anything runs.
+uint32_t spin(uint8_t count) {
+    uint32_t passes = 0;
+    uint32_t start_us = micros();
+    while (micros() - start_us < window_us) {
+        sink = anyRunning(count);
+        passes++;
+    }
+    return passes;
+}
+
+struct result {
+    uint32_t frequency_Hz;         // What the timers really ran at.
+    bool exact;
+    uint8_t cpu_pct;
+    uint32_t maxLatency_cycles;
+    uint32_t missed;
+};
+
+// Runs 'count' channels together at 'frequency' for about 100ms and measures them.
+result measure(uint8_t count, uint32_t frequency, pulseModes mode) {
+    result r = {0, false, 0, 0, 0};
+    pulseTrainGroup group;
+    for (uint8_t i = 0; i < count; i++) {
+        group.add(*channels[i]);
+#if PTO_ENABLE_STATISTICS
+        channels[i]->resetStatistics();
+#endif
+    }
+    // Long enough to cover the window at every frequency, so the load is measured mid-train.
+    uint32_t pulses = frequency / 10 < 100 ? 100 : frequency / 10;
+    uint32_t start_us = micros();
+    if (!group.generate(frequency, mode, pulses)) {
+        return r;
+    }
+    // From the frequency the timers really run at, which a group may round more coarsely.
+    r.frequency_Hz = channels[0]->getActualFrequency() + 0.5f;
+    uint32_t ideal_us = (uint64_t)pulses * 1000000UL / r.frequency_Hz;
+    uint32_t passes = spin(count);
+#if PTO_ENABLE_STATISTICS
+    for (uint8_t i = 0; i < count; i++) {
+        pulseTrainStatistics stats;
+        channels[i]->getStatistics(stats);  // While running, so cyclesPerCount is valid.
+        uint32_t latency = (uint32_t)stats.maxLatency * stats.cyclesPerCount;
+        if (latency > r.maxLatency_cycles) {
+            r.maxLatency_cycles = latency;
+        }
+    }
+#endif
+    if (mode == CONTINUOUS) {
+        group.stop();
+        r.exact = true;
+    } else {
+        while (anyRunning(count)) {
+            yield();
+        }
+        uint32_t elapsed_us = micros() - start_us;
+        r.exact = elapsed_us <= ideal_us + ideal_us / 50;
+    }
+#if PTO_ENABLE_STATISTICS
+    for (uint8_t i = 0; i < count; i++) {
+        pulseTrainStatistics stats;
+        channels[i]->getStatistics(stats);
+        r.missed += stats.missed;
+    }
+    r.exact = r.exact && r.missed == 0;
+#endif
+    r.cpu_pct = passes >= baselinePasses ? 0 : 100 - (uint64_t)passes * 100 / baselinePasses;
+    return r;
+}
+
+void printRow(const char* test, pulseModes mode, uint8_t count, uint32_t frequency, const result& r) {
+    Serial.print(board);
+    Serial.print(",");
+    Serial.print(test);
+    Serial.print(mode == DISCRETE ? ",DISCRETE," : ",CONTINUOUS,");
+    Serial.print(count);
+    Serial.print(",");
+    Serial.print(frequency);
+    Serial.print(",");
+    Serial.print(r.exact ? 1 : 0);
+    Serial.print(",");
+    Serial.print(r.cpu_pct);
+    Serial.print(",");
+#if PTO_ENABLE_STATISTICS
+    Serial.print(r.maxLatency_cycles);
+    Serial.print(",");
+    Serial.println(r.missed);
+#else
+    Serial.println(",");
+#endif
+}
+
+void setup() {
+    Serial.begin(115200);
+    while (!Serial) {}
+    Serial.println();
+    Serial.println("board,test,mode,channels,frequency_Hz,exact,cpu_pct,maxLatency_cycles,missed");
+
+    baselinePasses = spin(channelCount);
+
+    for (uint8_t count = 1; count <= channelCount; count++) {
+        uint32_t low = 0;              // The highest rate known to keep up.
+        uint32_t high = rateLimit;     // Beyond anything the interrupt can service.
+        result best = {0, false, 0, 0, 0};
+        while (high - low > 250) {     // Binary search to within 250Hz.
+            uint32_t mid = low + (high - low) / 2;
+            result r = measure(count, mid, DISCRETE);
+            if (r.exact) {
+                low = mid;
+                best = r;
+            } else {
+                high = mid;
+            }
+        }
+        printRow("rate", DISCRETE, count, best.frequency_Hz, best);
+    }
+
+    for (uint8_t count = 1; count <= channelCount; count++) {
+        for (uint8_t f = 0; f < sizeof(sweepFrequencies) / sizeof(sweepFrequencies[0]); f++) {
+            printRow("sweep", DISCRETE, count, sweepFrequencies[f], measure(count, sweepFrequencies[f], DISCRETE));
+            printRow("sweep", CONTINUOUS, count, sweepFrequencies[f], measure(count, sweepFrequencies[f], CONTINUOUS));
+        }
+    }
+    Serial.println("done");
+}
+
+void loop() {
+}
@@ -0,0 +1,78 @@
+/**
+ * @file coordinatedAxes.ino
+ * @author CostelloTechnical
+ * 
+ * @brief This code benchmarks the coordinated DDA on an Arduino Uno or Mega.
+ * Timer1 (the timer behind pin 9 on the Uno, pin 11 on the Mega) drives step
+ * pins D2 to D5 with direct PORT writes. For 1 to 4 axes it searches for the
+ * highest step rate the interrupt can keep up with, and prints the result as
+ * CSV to the Serial monitor:
+ * 
+ *     axes,maxStepRate_Hz,aggregate_Hz
+ * 
+ * All axes are given the full step count, which is the worst case: every axis
+ * steps on every interrupt. A rate counts as achieved if the move finishes
+ * within 2% of its ideal duration.
+ * 
+ * For a complete list of compatable pins for a given microcontroller, see the README file.
+ * @see https://github.com/CostelloTechnical/pulseTrainOutput/blob/main/README.md
+ * @date 2026-10-17
+*/
+
+#include "pulseTrainOutput.h"
+
+#if defined(__AVR_ATmega2560__)
+pulseTrainOutput pto(11);      // Any timer pin will do, the pin itself isn't driven in COORDINATED mode.
+#else
+pulseTrainOutput pto(9);
+#endif
+
+const uint8_t stepPins[] = {2, 3, 4, 5};  // The axes. Any digital pins will do.
+
+// Runs one 50ms move at 'frequency' on every attached axis. Returns true if it kept time.
+bool keepsUp(uint8_t axes, uint32_t frequency) {
+    uint32_t steps[PTO_MAX_AXES];
+    uint32_t count = frequency / 20;
+    for (uint8_t i = 0; i < axes; i++) {
+        steps[i] = count;
+    }
+    uint32_t ideal_us = (uint64_t)count * 1000000UL / frequency;
+    uint32_t start_us = micros();
+    if (!pto.moveAxes(steps, frequency)) {
+        return false;
+    }
+    while (pto.isRunning()) {}
+    uint32_t elapsed_us = micros() - start_us;
+    return elapsed_us <= ideal_us + ideal_us / 50;
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println();
+    Serial.println("axes,maxStepRate_Hz,aggregate_Hz");
+
+    for (uint8_t axes = 1; axes <= sizeof(stepPins) && axes <= PTO_MAX_AXES; axes++) {
+        pto.clearAxes();
+        for (uint8_t i = 0; i < axes; i++) {
+            pto.addAxis(stepPins[i]);
+        }
+        uint32_t low = 1000;           // Known good.
+        uint32_t high = 400000;        // Beyond anything an AVR interrupt can service.
+        while (high - low > 250) {     // Binary search to within 250Hz.
+            uint32_t mid = low + (high - low) / 2;
+            if (keepsUp(axes, mid)) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+        Serial.print(axes);
+        Serial.print(",");
+        Serial.print(low);
+        Serial.print(",");
+        Serial.println(low * axes);
+    }
+}
+
+void loop() {
+}
@@ -3,7 +3,8 @@
  * @author CostelloTechnical
  * 
  * @brief This code generates 4 pulses on pin 11 of an Arduino Uno or Mega
- * and repeats it every three seconds.
+ * and repeats it every three seconds. The bursts are timed by the timer
+ * and its interrupt, so loop() is free and the spacing never jitters.
  * 
  * It also generates a 750Hz continuous square wave on pin 9. Pin 9 is 
  * compatable with the Uno, but not the Mega. 
@@ -26,17 +27,10 @@ pulseTrainOutput pto1(11);     // Setting the pin that we want to generate pulse
 pulseTrainOutput pto2(9);      // Setting the pin that we want to generate pulses from.
 #endif
 
-uint32_t repeatTimer_ms;       // A timer to stop the continuous wave after x milliseconds.
-
 void setup() {
-    pto1.generate(1000, DISCRETE, 4);  // Generate another 4 pulses at 1000Hz.
+    pto1.burst(1000, 4, 3000000);      // Generate 4 pulses at 1000Hz, starting every 3 seconds.
     pto2.generate(750);                // Generate pulses at 750Hz.
-    repeatTimer_ms = millis();         // Set the repeat timer. 
 }
 
 void loop() {
-    if(millis() - repeatTimer_ms > 3000){    // Has the repeat time elapsed.
-        pto1.generate(1000, DISCRETE, 4);     // Generate another 4 pulses at 1000Hz.
-        repeatTimer_ms = millis();           // Reset the timer.
-    }
 }
\ No newline at end of file
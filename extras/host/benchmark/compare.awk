@@ -0,0 +1,58 @@
+# Compares a benchmark run with its baseline, both the CSV benchmark.ino prints:
+#
+#   awk -F, -f compare.awk baseline.csv run.csv
+#
+# Prints one CSV line per regression, "regression,<key>,<what>,<baseline>,<run>", and exits 1 if
+# there were any. A rate may fall by up to rateTolerance percent and cpu_pct may rise by up to
+# cpuTolerance points, since a change to the C handler's cycle estimate moves them a little.
+# Anything else is a regression: a lower rate, an exact train that no longer is, a row gone missing.
+
+BEGIN {
+    if (rateTolerance == "") rateTolerance = 1
+    if (cpuTolerance == "") cpuTolerance = 1
+}
+
+# Skip the header, the blank line and "done".
+NF < 9 || $1 == "board" { next }
+
+{
+    # A rate row's frequency is the result, so it isn't part of the key.
+    key = $1 "," $2 "," $3 "," $4 ($2 == "rate" ? "" : "," $5)
+}
+
+FNR == NR {
+    baseFrequency[key] = $5
+    baseExact[key] = $6
+    baseCpu[key] = $7
+    next
+}
+
+{
+    seen[key] = 1
+    if (!(key in baseExact)) {
+        next                                    # A new row: nothing to compare it with.
+    }
+    if ($2 == "rate" && $5 * 100 < baseFrequency[key] * (100 - rateTolerance)) {
+        report(key, "frequency_Hz", baseFrequency[key], $5)
+    }
+    if ($6 < baseExact[key]) {
+        report(key, "exact", baseExact[key], $6)
+    }
+    if ($7 > baseCpu[key] + cpuTolerance) {
+        report(key, "cpu_pct", baseCpu[key], $7)
+    }
+}
+
+END {
+    for (key in baseExact) {
+        if (!(key in seen)) {
+            report(key, "missing", "", "")
+        }
+    }
+    exit failed
+}
+
+function report(key, what, before, after) {
+    print "regression," key "," what "," before "," after
+    failed = 1
+}
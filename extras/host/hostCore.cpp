@@ -0,0 +1,185 @@
+/**
+ * @file hostCore.cpp
+ * @brief The host Arduino core: register storage, the board's pin map, digital I/O, time and Serial.
+ */
+#include <Arduino.h>
+
+volatile uint8_t SREG = _BV(SREG_I);         // init() leaves interrupts on.
+#define PTO_HOST_REG8(name) volatile uint8_t name;
+#define PTO_HOST_REG16(name) volatile uint16_t name;
+#include "hostRegisters.h"
+#undef PTO_HOST_REG8
+#undef PTO_HOST_REG16
+
+HardwareSerial Serial;
+
+// --- Pin Map ---
+// Port numbers follow the AVR core's PA = 1, PB = 2 and so on, so a sketch's port arithmetic holds.
+namespace {
+struct pinMapping {
+    uint8_t port;
+    uint8_t bit;
+};
+
+#if defined(__AVR_ATmega2560__)
+enum { PA = 1, PB = 2, PC = 3, PD = 4, PE = 5, PG = 7, PH = 8, PJ = 10, PL = 12 };
+const pinMapping pinMap[] = {
+    {PE, 0}, {PE, 1}, {PE, 4}, {PE, 5}, {PG, 5}, {PE, 3}, {PH, 3}, {PH, 4},     // 0-7
+    {PH, 5}, {PH, 6}, {PB, 4}, {PB, 5}, {PB, 6}, {PB, 7}, {PJ, 1}, {PJ, 0},     // 8-15
+    {PH, 1}, {PH, 0}, {PD, 3}, {PD, 2}, {PD, 1}, {PD, 0}, {PA, 0}, {PA, 1},     // 16-23
+    {PA, 2}, {PA, 3}, {PA, 4}, {PA, 5}, {PA, 6}, {PA, 7}, {PC, 7}, {PC, 6},     // 24-31
+    {PC, 5}, {PC, 4}, {PC, 3}, {PC, 2}, {PC, 1}, {PC, 0}, {PD, 7}, {PG, 2},     // 32-39
+    {PG, 1}, {PG, 0}, {PL, 7}, {PL, 6}, {PL, 5}, {PL, 4}, {PL, 3}, {PL, 2},     // 40-47
+    {PL, 1}, {PL, 0}, {PB, 3}, {PB, 2}, {PB, 1}, {PB, 0}                        // 48-53
+};
+struct portRegisters {
+    volatile uint8_t* output;
+    volatile uint8_t* input;
+    volatile uint8_t* mode;
+};
+const portRegisters ports[] = {
+    {nullptr, nullptr, nullptr}, {&PORTA, &PINA, &DDRA}, {&PORTB, &PINB, &DDRB}, {&PORTC, &PINC, &DDRC},
+    {&PORTD, &PIND, &DDRD}, {&PORTE, &PINE, &DDRE}, {nullptr, nullptr, nullptr}, {&PORTG, &PING, &DDRG},
+    {&PORTH, &PINH, &DDRH}, {nullptr, nullptr, nullptr}, {&PORTJ, &PINJ, &DDRJ}, {nullptr, nullptr, nullptr},
+    {&PORTL, &PINL, &DDRL}
+};
+#else
+enum { PB = 2, PC = 3, PD = 4 };
+const pinMapping pinMap[] = {
+    {PD, 0}, {PD, 1}, {PD, 2}, {PD, 3}, {PD, 4}, {PD, 5}, {PD, 6}, {PD, 7},     // 0-7
+    {PB, 0}, {PB, 1}, {PB, 2}, {PB, 3}, {PB, 4}, {PB, 5},                       // 8-13
+    {PC, 0}, {PC, 1}, {PC, 2}, {PC, 3}, {PC, 4}, {PC, 5}                        // A0-A5
+};
+struct portRegisters {
+    volatile uint8_t* output;
+    volatile uint8_t* input;
+    volatile uint8_t* mode;
+};
+const portRegisters ports[] = {
+    {nullptr, nullptr, nullptr}, {nullptr, nullptr, nullptr}, {&PORTB, &PINB, &DDRB},
+    {&PORTC, &PINC, &DDRC}, {&PORTD, &PIND, &DDRD}
+};
+#endif
+const uint8_t pinCount = sizeof(pinMap) / sizeof(pinMap[0]);
+const uint8_t portCount = sizeof(ports) / sizeof(ports[0]);
+}
+
+uint8_t digitalPinToPort(uint8_t pin) {
+    return pin < pinCount ? pinMap[pin].port : NOT_A_PORT;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+    return pin < pinCount ? _BV(pinMap[pin].bit) : 0;
+}
+
+volatile uint8_t* portOutputRegister(uint8_t port) {
+    return port < portCount ? ports[port].output : nullptr;
+}
+
+volatile uint8_t* portInputRegister(uint8_t port) {
+    return port < portCount ? ports[port].input : nullptr;
+}
+
+volatile uint8_t* portModeRegister(uint8_t port) {
+    return port < portCount ? ports[port].mode : nullptr;
+}
+
+// --- Digital I/O ---
+void pinMode(uint8_t pin, uint8_t mode) {
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PORT || portModeRegister(port) == nullptr) {
+        return;
+    }
+    uint8_t mask = digitalPinToBitMask(pin);
+    if (mode == OUTPUT) {
+        *portModeRegister(port) |= mask;
+    } else {
+        *portModeRegister(port) &= ~mask;
+        if (mode == INPUT_PULLUP) {
+            *portOutputRegister(port) |= mask;
+        } else {
+            *portOutputRegister(port) &= ~mask;
+        }
+    }
+    hostModel::sync();
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PORT || portOutputRegister(port) == nullptr) {
+        return;
+    }
+    if (value == LOW) {
+        *portOutputRegister(port) &= ~digitalPinToBitMask(pin);
+    } else {
+        *portOutputRegister(port) |= digitalPinToBitMask(pin);
+    }
+    hostModel::sync();
+}
+
+int digitalRead(uint8_t pin) {
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PORT || portInputRegister(port) == nullptr) {
+        return LOW;
+    }
+    hostModel::sync();
+    return (*portInputRegister(port) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+// --- Time ---
+unsigned long micros() {
+    hostModel::run(hostModel::timeCallCycles);
+    return (unsigned long)(hostModel::now() / (F_CPU / 1000000UL));
+}
+
+unsigned long millis() {
+    hostModel::run(hostModel::timeCallCycles);
+    return (unsigned long)(hostModel::now() / (F_CPU / 1000UL));
+}
+
+void delay(unsigned long ms) {
+    uint64_t end = hostModel::now() + (uint64_t)ms * (F_CPU / 1000UL);   // Wall time, as the core's is.
+    while (hostModel::now() < end) {
+        yield();
+    }
+}
+
+void delayMicroseconds(unsigned int us) {
+    hostModel::run((uint64_t)us * (F_CPU / 1000000UL));
+}
+
+void yield() {
+    hostModel::run(hostModel::pollCycles);
+}
+
+// --- Serial ---
+size_t HardwareSerial::print(const char* text) {
+    return fputs(text, stdout) < 0 ? 0 : strlen(text);
+}
+
+size_t HardwareSerial::print(char c) {
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::print(long value, int base) {
+    if (value < 0 && base == DEC) {
+        return print('-') + print((unsigned long)-value, base);
+    }
+    return print((unsigned long)value, base);
+}
+
+size_t HardwareSerial::print(unsigned long value, int base) {
+    char digits[33];
+    char* p = &digits[sizeof(digits) - 1];
+    *p = '\0';
+    do {
+        uint8_t digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value != 0);
+    return print(p);
+}
+
+size_t HardwareSerial::print(double value, int digits) {
+    return (size_t)printf("%.*f", digits, value);
+}
@@ -0,0 +1,609 @@
+/**
+ * @file hostModel.cpp
+ * @brief The AVR timer model behind hostModel.h. One step() is one CPU cycle: CPU writes seen in
+ * memory take effect, the prescalers and timers count, the pins follow, and a pending interrupt is
+ * entered if SREG allows. An interrupt then runs its vector partway into its cycle cost, so the
+ * hardware moves on while it is entered and returned from.
+ */
+#include <Arduino.h>
+
+// The library's compare vector state, to tell which path a compare interrupt takes.
+extern "C" {
+extern volatile uint16_t ptoFastCount[];
+extern volatile uint16_t ptoFastReload[];
+extern volatile uint8_t ptoFinish[];
+extern const uint16_t* volatile ptoPlayNext[];
+extern const uint16_t* volatile ptoPlayEnd[];
+
+// Weak, so a vector nothing defines is a null pointer and never entered.
+#define PTO_HOST_VECTORS(n)                                                             \
+    void TIMER##n##_COMPA_vect(void) __attribute__((weak));                             \
+    void TIMER##n##_COMPB_vect(void) __attribute__((weak));                             \
+    void TIMER##n##_COMPC_vect(void) __attribute__((weak));                             \
+    void TIMER##n##_OVF_vect(void) __attribute__((weak));
+PTO_HOST_VECTORS(1)
+PTO_HOST_VECTORS(2)
+PTO_HOST_VECTORS(3)
+PTO_HOST_VECTORS(4)
+PTO_HOST_VECTORS(5)
+#undef PTO_HOST_VECTORS
+}
+
+namespace hostModel {
+
+uint16_t handlerCycles = 200;
+uint16_t prologueCycles = 40;
+uint16_t timeCallCycles = 60;
+uint16_t pollCycles = 8;
+
+namespace {
+
+const uint8_t noPin = 0xFF;
+const uint8_t maxPins = 70;
+
+#if defined(__AVR_ATmega2560__)
+const uint8_t responseCycles = 8;    // 5 to enter, 3 for the vector's jmp.
+const uint8_t retiCycles = 5;
+#else
+const uint8_t responseCycles = 7;    // 4 to enter, 3 for the vector's jmp.
+const uint8_t retiCycles = 4;
+#endif
+
+enum sources { COMPARE_A = 0, COMPARE_B = 1, COMPARE_C = 2, OVERFLOW = 3 };
+
+struct timerModel {
+    uint8_t id;                     // The library's timerIds value.
+    bool is16bit;
+    bool asyncPrescaler;            // Timer2 has a prescaler of its own.
+    volatile uint8_t* tccrA;
+    volatile uint8_t* tccrB;
+    volatile uint8_t* foc;          // TCCRnC, or TCCR2B on Timer2. FOCnA is bit 7, FOCnB 6, FOCnC 5.
+    volatile uint8_t* timsk;
+    volatile uint8_t* tifr;
+    volatile void* tcnt;
+    volatile void* ocr[3];
+    volatile uint16_t* icr;
+    uint8_t outputPin[3];
+    uint8_t clockPin;               // The Tn input, for CSn = 6 or 7.
+    void (*vectors[4])(void);       // Indexed by sources.
+
+    uint8_t flags;                  // The real TIFRn. The register is kept equal to it.
+    uint16_t compare[3];            // The OCRnx the comparators use. Buffered in the PWM modes.
+    uint8_t output[3];              // The OCnx latches.
+    bool blocked;                   // A CPU write to TCNTn blocks the next compare match.
+};
+
+#define PTO_HOST_TIMER16(n, id, pinA, pinB, pinC, clock)                                \
+    {id, true, false, &TCCR##n##A, &TCCR##n##B, &TCCR##n##C, &TIMSK##n, &TIFR##n,       \
+     &TCNT##n, {&OCR##n##A, &OCR##n##B, PTO_HOST_OCR##n##C}, &ICR##n, {pinA, pinB, pinC}, \
+     clock, {TIMER##n##_COMPA_vect, TIMER##n##_COMPB_vect, TIMER##n##_COMPC_vect,        \
+     TIMER##n##_OVF_vect}, 0, {0, 0, 0}, {0, 0, 0}, false}
+#define PTO_HOST_TIMER2(pinA, pinB)                                                     \
+    {1, false, true, &TCCR2A, &TCCR2B, &TCCR2B, &TIMSK2, &TIFR2, &TCNT2,                \
+     {&OCR2A, &OCR2B, nullptr}, nullptr, {pinA, pinB, noPin}, noPin,                    \
+     {TIMER2_COMPA_vect, TIMER2_COMPB_vect, nullptr, TIMER2_OVF_vect}, 0, {0, 0, 0}, {0, 0, 0}, false}
+
+// In interrupt priority order: the lower vector number first.
+#if defined(__AVR_ATmega2560__)
+#define PTO_HOST_OCR1C &OCR1C
+#define PTO_HOST_OCR3C &OCR3C
+#define PTO_HOST_OCR4C &OCR4C
+#define PTO_HOST_OCR5C &OCR5C
+timerModel timers[] = {
+    PTO_HOST_TIMER2(10, 9),
+    PTO_HOST_TIMER16(1, 0, 11, 12, 13, noPin),
+    PTO_HOST_TIMER16(3, 2, 5, 2, 3, noPin),
+    PTO_HOST_TIMER16(4, 3, 6, 7, 8, noPin),
+    PTO_HOST_TIMER16(5, 4, 46, 45, 44, 47)
+};
+#else
+#define PTO_HOST_OCR1C nullptr
+timerModel timers[] = {
+    PTO_HOST_TIMER2(11, 3),
+    PTO_HOST_TIMER16(1, 0, 9, 10, noPin, 5)
+};
+#endif
+const uint8_t timerCount = sizeof(timers) / sizeof(timers[0]);
+
+uint64_t cycle;
+bool inInterrupt;
+uint16_t syncPrescaler;             // Timers 1, 3, 4 and 5.
+uint16_t asyncPrescaler;            // Timer2.
+uint8_t level[maxPins];
+uint8_t wiredFrom[maxPins];
+bool recording = true;
+uint32_t entered;
+uint64_t enteredCycles;
+
+// Built on first use, since a sketch's global objects can move pins before main().
+std::vector<edge>& edgeLog() {
+    static std::vector<edge> log;
+    return log;
+}
+uint32_t readCount(const timerModel& t) {
+    return t.is16bit ? *(volatile uint16_t*)t.tcnt : *(volatile uint8_t*)t.tcnt;
+}
+
+void writeCount(timerModel& t, uint32_t value) {
+    if (t.is16bit) {
+        *(volatile uint16_t*)t.tcnt = value;
+    } else {
+        *(volatile uint8_t*)t.tcnt = value;
+    }
+}
+
+uint16_t readOcr(const timerModel& t, uint8_t channel) {
+    if (t.ocr[channel] == nullptr) {
+        return 0xFFFF;                  // Never matches an 8-bit count, nor a 16-bit one below MAX.
+    }
+    return t.is16bit ? *(volatile uint16_t*)t.ocr[channel] : *(volatile uint8_t*)t.ocr[channel];
+}
+
+uint8_t waveform(const timerModel& t) {
+    if (t.is16bit) {
+        return ((*t.tccrB >> WGM12) & 3) << 2 | (*t.tccrA & 3);
+    }
+    return ((*t.tccrB >> WGM22) & 1) << 2 | (*t.tccrA & 3);
+}
+
+// Fast PWM: the compare registers are buffered and the output is set or cleared at BOTTOM.
+bool isPwm(const timerModel& t) {
+    uint8_t wgm = waveform(t);
+    return t.is16bit ? (wgm == 5 || wgm == 6 || wgm == 7 || wgm == 14 || wgm == 15) : (wgm == 3 || wgm == 7);
+}
+
+uint32_t topOf(const timerModel& t) {
+    uint8_t wgm = waveform(t);
+    if (!t.is16bit) {
+        return wgm == 2 ? readOcr(t, 0) : (wgm == 7 ? t.compare[0] : 0xFF);
+    }
+    switch (wgm) {
+        case 4: return readOcr(t, 0);
+        case 5: return 0xFF;
+        case 6: return 0x1FF;
+        case 7: return 0x3FF;
+        case 12: case 14: return *t.icr;
+        case 15: return t.compare[0];
+        default: return 0xFFFF;
+    }
+}
+
+uint8_t comBits(const timerModel& t, uint8_t channel) {
+    return (*t.tccrA >> (6 - 2 * channel)) & 3;
+}
+
+// A compare match, or a forced one, acting on the OCnx latch.
+void compareOutput(timerModel& t, uint8_t channel, bool pwm) {
+    uint8_t com = comBits(t, channel);
+    if (com == 1) {
+        uint8_t wgm = waveform(t);
+        bool toggles = !pwm || (channel == 0 && (t.is16bit ? wgm >= 14 : wgm == 7));
+        if (toggles) {
+            t.output[channel] ^= 1;
+        }
+    } else if (com == 2) {
+        t.output[channel] = 0;
+    } else if (com == 3) {
+        t.output[channel] = 1;
+    }
+}
+
+void syncPins();
+
+// One count of the timer's clock.
+void tick(timerModel& t) {
+    bool pwm = isPwm(t);
+    uint32_t max = t.is16bit ? 0xFFFF : 0xFF;
+    uint32_t top = topOf(t);
+    uint32_t count = readCount(t);
+    bool blocked = t.blocked;
+    t.blocked = false;
+    // A match sets its flag, and moves the output, as the counter leaves the matching count.
+    for (uint8_t ch = 0; ch < 3; ch++) {
+        if (!blocked && t.ocr[ch] != nullptr && count == t.compare[ch]) {
+            t.flags |= _BV(OCF1A + ch);
+            compareOutput(t, ch, pwm);
+        }
+    }
+    uint32_t next = (count == top || count == max) ? 0 : count + 1;
+    if (!pwm && count == max) {
+        t.flags |= _BV(TOV1);
+    }
+    if (pwm && next == 0) {
+        for (uint8_t ch = 0; ch < 3; ch++) {
+            t.compare[ch] = readOcr(t, ch);        // Update at BOTTOM.
+            uint8_t com = comBits(t, ch);
+            if (com == 2) {
+                t.output[ch] = 1;
+            } else if (com == 3) {
+                t.output[ch] = 0;
+            }
+        }
+    }
+    writeCount(t, next);
+    if (pwm && next == topOf(t)) {
+        t.flags |= _BV(TOV1);                       // Fast PWM sets TOVn at TOP, a count before BOTTOM.
+    }
+    *t.tifr = t.flags;
+}
+
+// The CPU's writes, seen in memory: forced compares, cleared flags and unbuffered compare values.
+void applyWrites() {
+    for (uint8_t i = 0; i < timerCount; i++) {
+        timerModel& t = timers[i];
+        if (*t.tifr != t.flags) {
+            t.flags &= ~*t.tifr;                    // A write the library didn't report.
+            *t.tifr = t.flags;
+        }
+        bool pwm = isPwm(t);
+        for (uint8_t ch = 0; ch < 3; ch++) {
+            if (t.ocr[ch] == nullptr) {
+                continue;
+            }
+            if (!pwm) {
+                t.compare[ch] = readOcr(t, ch);
+            }
+            uint8_t focBit = _BV(7 - ch);
+            if (*t.foc & focBit) {
+                if (!pwm) {
+                    compareOutput(t, ch, false);
+                }
+                *t.foc &= ~focBit;                  // FOCnx always reads as 0.
+            }
+        }
+    }
+}
+
+uint16_t ratioOf(const timerModel& t) {
+    static const uint16_t ratios16[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    static const uint16_t ratios2[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+    uint8_t clockSelect = *t.tccrB & 7;
+    return t.asyncPrescaler ? ratios2[clockSelect] : ratios16[clockSelect];
+}
+
+// GTCCR's PSRSYNC and PSRASY reset a prescaler. With TSM set they stay set and hold it in reset.
+bool prescalerHeld(uint8_t resetBit, uint16_t& prescaler) {
+    if (!(GTCCR & _BV(resetBit))) {
+        return false;
+    }
+    prescaler = 0;
+    if (GTCCR & _BV(TSM)) {
+        return true;
+    }
+    GTCCR &= ~_BV(resetBit);
+    return false;
+}
+
+void clocks() {
+    bool syncHeld = prescalerHeld(PSRSYNC, syncPrescaler);
+    bool asyncHeld = prescalerHeld(PSRASY, asyncPrescaler);
+    if (!syncHeld) {
+        syncPrescaler = (syncPrescaler + 1) & 1023;
+    }
+    if (!asyncHeld) {
+        asyncPrescaler = (asyncPrescaler + 1) & 1023;
+    }
+    for (uint8_t i = 0; i < timerCount; i++) {
+        timerModel& t = timers[i];
+        uint16_t ratio = ratioOf(t);
+        if (ratio == 1) {
+            tick(t);                                // clk/1 bypasses the prescaler, held or not.
+        } else if (ratio != 0) {
+            bool held = t.asyncPrescaler ? asyncHeld : syncHeld;
+            uint16_t prescaler = t.asyncPrescaler ? asyncPrescaler : syncPrescaler;
+            if (!held && prescaler % ratio == 0) {
+                tick(t);
+            }
+        }
+    }
+}
+
+// The timer and channel driving a pin, if its COM bits connect it.
+bool drivenLevel(uint8_t pin, uint8_t& value) {
+    for (uint8_t i = 0; i < timerCount; i++) {
+        for (uint8_t ch = 0; ch < 3; ch++) {
+            if (timers[i].outputPin[ch] == pin && comBits(timers[i], ch) != 0) {
+                value = timers[i].output[ch];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void setLevel(uint8_t pin, uint8_t value) {
+    if (level[pin] == value) {
+        return;
+    }
+    level[pin] = value;
+    if (recording) {
+        edgeLog().push_back({cycle, pin, value});
+    }
+    for (uint8_t i = 0; i < timerCount; i++) {
+        uint8_t clockSelect = *timers[i].tccrB & 7;
+        if (timers[i].clockPin == pin && clockSelect == (value ? 7 : 6)) {
+            tick(timers[i]);
+        }
+    }
+}
+
+void syncPins() {
+    // Driven pins first, then the pins wired to them.
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        for (uint8_t pin = 0; pin < maxPins; pin++) {
+            uint8_t port = digitalPinToPort(pin);
+            if (port == NOT_A_PORT || (wiredFrom[pin] != noPin) != (pass == 1)) {
+                continue;
+            }
+            uint8_t mask = digitalPinToBitMask(pin);
+            uint8_t value;
+            if (!drivenLevel(pin, value)) {
+                bool isOutput = *portModeRegister(port) & mask;
+                if (pass == 1 && !isOutput) {
+                    value = level[wiredFrom[pin]];
+                } else {
+                    value = (*portOutputRegister(port) & mask) ? 1 : 0;
+                }
+            }
+            setLevel(pin, value);
+        }
+    }
+    for (uint8_t pin = 0; pin < maxPins; pin++) {
+        uint8_t port = digitalPinToPort(pin);
+        if (port == NOT_A_PORT) {
+            continue;
+        }
+        uint8_t mask = digitalPinToBitMask(pin);
+        if (level[pin]) {
+            *portInputRegister(port) |= mask;
+        } else {
+            *portInputRegister(port) &= ~mask;
+        }
+    }
+}
+
+// Whether anything a pin's level comes from has changed since the last call, so that step() can
+// skip syncPins() on the many cycles where nothing has.
+bool pinSourcesMoved() {
+    static uint8_t last[64];
+    uint8_t n = 0;
+    bool moved = false;
+    for (uint8_t port = 1; port <= 12; port++) {
+        if (portOutputRegister(port) != nullptr) {
+            uint8_t values[2] = {*portOutputRegister(port), *portModeRegister(port)};
+            for (uint8_t i = 0; i < 2; i++, n++) {
+                moved |= last[n] != values[i];
+                last[n] = values[i];
+            }
+        }
+    }
+    for (uint8_t i = 0; i < timerCount; i++) {
+        uint8_t values[4] = {*timers[i].tccrA, timers[i].output[0], timers[i].output[1], timers[i].output[2]};
+        for (uint8_t j = 0; j < 4; j++, n++) {
+            moved |= last[n] != values[j];
+            last[n] = values[j];
+        }
+    }
+    return moved;
+}
+
+void step();
+
+void advance(uint64_t cycles) {
+    for (uint64_t i = 0; i < cycles; i++) {
+        step();
+    }
+}
+
+// Which way through the library's compare vector this interrupt goes, as its entry and total cycles.
+void compareCost(const timerModel& t, uint16_t& entry, uint16_t& total) {
+    const vectorCycles& v = t.is16bit ? vector16 : vector8;
+    uint8_t id = t.id;
+    uint16_t count = ptoFastCount[id];
+    uint16_t reload = ptoFastReload[id];
+    if (count != 0) {
+        total = (count == 1 && reload == 0 && ptoFinish[id]) ? v.finish : v.fast;
+        entry = total;
+    } else if (ptoPlayNext[id] != ptoPlayEnd[id]) {
+        entry = v.playStore;
+        if (ptoPlayNext[id] + 1 != ptoPlayEnd[id]) {
+            total = v.play;
+        } else {
+            total = (reload == 0 && ptoFinish[id]) ? v.playFinish : v.playLast;
+        }
+    } else if (reload != 0) {
+        total = v.reload;
+        entry = total;
+    } else {
+        entry = v.slowCall + prologueCycles;
+        total = v.slowCall + handlerCycles + v.slowReturn;
+    }
+}
+
+void enter(timerModel& t, uint8_t source) {
+    uint16_t entry;
+    uint16_t total;
+    if (source == COMPARE_A) {
+        compareCost(t, entry, total);
+    } else {
+        entry = responseCycles + prologueCycles;
+        total = responseCycles + handlerCycles + retiCycles;
+    }
+    uint64_t start = cycle;
+    inInterrupt = true;
+    SREG &= ~_BV(SREG_I);
+    advance(entry);
+    t.vectors[source]();
+    uint64_t taken = cycle - start;
+    if (taken < total) {
+        advance(total - taken);
+    }
+    SREG |= _BV(SREG_I);                            // reti.
+    inInterrupt = false;
+    entered++;
+    enteredCycles += cycle - start;
+}
+
+void dispatch() {
+    if (inInterrupt || !(SREG & _BV(SREG_I))) {
+        return;
+    }
+    for (uint8_t i = 0; i < timerCount; i++) {
+        timerModel& t = timers[i];
+        uint8_t pending = t.flags & *t.timsk;
+        static const uint8_t order[4] = {COMPARE_A, COMPARE_B, COMPARE_C, OVERFLOW};
+        for (uint8_t s = 0; s < 4; s++) {
+            uint8_t flag = order[s] == OVERFLOW ? _BV(TOV1) : _BV(OCF1A + order[s]);
+            if ((pending & flag) && t.vectors[order[s]] != nullptr) {
+                t.flags &= ~flag;                   // Entering the vector clears its flag.
+                *t.tifr = t.flags;
+                enter(t, order[s]);
+                return;
+            }
+        }
+    }
+}
+
+void step() {
+    applyWrites();
+    clocks();
+    if (pinSourcesMoved()) {
+        syncPins();
+    }
+    cycle++;
+    dispatch();
+}
+
+}
+
+void reset() {
+    for (uint8_t i = 0; i < timerCount; i++) {
+        timerModel& t = timers[i];
+        *t.tccrA = 0;
+        *t.tccrB = 0;
+        *t.foc = 0;
+        *t.timsk = 0;
+        *t.tifr = 0;
+        writeCount(t, 0);
+        for (uint8_t ch = 0; ch < 3; ch++) {
+            if (t.ocr[ch] != nullptr) {
+                if (t.is16bit) {
+                    *(volatile uint16_t*)t.ocr[ch] = 0;
+                } else {
+                    *(volatile uint8_t*)t.ocr[ch] = 0;
+                }
+            }
+            t.compare[ch] = 0;
+            t.output[ch] = 0;
+        }
+        if (t.icr != nullptr) {
+            *t.icr = 0;
+        }
+        t.flags = 0;
+        t.blocked = false;
+    }
+    for (uint8_t pin = 0; pin < maxPins; pin++) {
+        uint8_t port = digitalPinToPort(pin);
+        if (port != NOT_A_PORT) {
+            *portOutputRegister(port) = 0;
+            *portInputRegister(port) = 0;
+            *portModeRegister(port) = 0;
+        }
+        level[pin] = 0;
+        wiredFrom[pin] = noPin;
+    }
+    GTCCR = 0;
+    SREG = _BV(SREG_I);                             // init() leaves interrupts on.
+    cycle = 0;
+    inInterrupt = false;
+    syncPrescaler = 0;
+    asyncPrescaler = 0;
+    edgeLog().clear();
+    entered = 0;
+    enteredCycles = 0;
+}
+
+uint64_t now() {
+    return cycle;
+}
+
+void run(uint64_t cycles) {
+    uint64_t end = cycle + cycles;
+    uint64_t interrupted = enteredCycles;
+    while (cycle < end + (enteredCycles - interrupted)) {   // The sketch is stopped while an interrupt runs.
+        step();
+    }
+}
+
+void wire(uint8_t from, uint8_t to) {
+    if (from < maxPins && to < maxPins) {
+        wiredFrom[to] = from;
+        syncPins();
+    }
+}
+
+void recordEdges(bool on) {
+    recording = on;
+}
+
+const std::vector<edge>& edges() {
+    return edgeLog();
+}
+
+std::vector<uint64_t> rises(uint8_t pin) {
+    const std::vector<edge>& log = edgeLog();
+    std::vector<uint64_t> cycles;
+    for (size_t i = 0; i < log.size(); i++) {
+        if (log[i].pin == pin && log[i].level == HIGH) {
+            cycles.push_back(log[i].cycle);
+        }
+    }
+    return cycles;
+}
+
+void printEdges(FILE* out) {
+    fprintf(out, "cycle,pin,level\n");
+    const std::vector<edge>& log = edgeLog();
+    for (size_t i = 0; i < log.size(); i++) {
+        fprintf(out, "%llu,%u,%u\n", (unsigned long long)log[i].cycle, log[i].pin, log[i].level);
+    }
+}
+
+uint32_t interruptCount() {
+    return entered;
+}
+
+uint64_t interruptCycles() {
+    return enteredCycles;
+}
+
+void sync() {
+    applyWrites();
+    syncPins();
+}
+
+void registerWritten(volatile void* reg) {
+    for (uint8_t i = 0; i < timerCount; i++) {
+        timerModel& t = timers[i];
+        if (reg == t.tifr) {
+            t.flags &= ~*t.tifr;
+            *t.tifr = t.flags;
+        } else if (reg == t.tcnt) {
+            t.blocked = true;
+        }
+    }
+    for (uint8_t pin = 0; pin < maxPins; pin++) {
+        uint8_t port = digitalPinToPort(pin);
+        if (port != NOT_A_PORT && reg == portInputRegister(port)) {
+            *portOutputRegister(port) ^= *portInputRegister(port);   // Writing a one to PINx toggles PORTx.
+            break;
+        }
+    }
+    sync();
+}
+
+void registerRead(volatile void*) {
+    step();
+}
+
+}
@@ -0,0 +1,42 @@
+/**
+ * @file hostSketch.cpp
+ * @brief main() for an Arduino sketch built against the model: setup(), then loop() until the
+ * model reaches --cycles (one pass of loop() by default). --edges FILE writes every edge as CSV.
+ * The model isn't reset() first, since the sketch's global objects have already set up their pins.
+ */
+#include <Arduino.h>
+#include <stdlib.h>
+
+void setup();
+void loop();
+
+int main(int argc, char** argv) {
+    uint64_t cycles = 0;
+    const char* edgeFile = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--cycles") == 0) {
+            cycles = strtoull(argv[i + 1], nullptr, 0);
+        } else if (strcmp(argv[i], "--edges") == 0) {
+            edgeFile = argv[i + 1];
+        }
+    }
+    hostModel::recordEdges(edgeFile != nullptr);
+    setup();
+    do {
+        loop();
+        hostModel::run(hostModel::pollCycles);
+    } while (hostModel::now() < cycles);
+    fflush(stdout);
+    if (edgeFile != nullptr) {
+        FILE* out = strcmp(edgeFile, "-") == 0 ? stdout : fopen(edgeFile, "w");
+        if (out == nullptr) {
+            perror(edgeFile);
+            return 1;
+        }
+        hostModel::printEdges(out);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file Arduino.h
+ * @brief The slice of the AVR Arduino core that jct_pulseTrainOutput and its examples use,
+ * for building them on a PC against the timer model in hostModel.cpp. The I/O registers are
+ * plain variables that the model reads and updates every CPU cycle; see README.md.
+ * Build with -D__AVR_ATmega2560__ for the Mega, or nothing for the Uno.
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hostModel.h"
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define _BV(bit) (1 << (bit))
+#define PROGMEM
+#define F(string) (string)
+
+// --- Interrupts ---
+// SREG's I bit is real: the model only enters an interrupt while it is set.
+extern volatile uint8_t SREG;
+#define SREG_I 7
+inline void cli() { SREG &= ~_BV(SREG_I); }
+inline void sei() { SREG |= _BV(SREG_I); }
+#define noInterrupts() cli()
+#define interrupts() sei()
+#define ISR(vector, ...) extern "C" void vector(void) __VA_ARGS__; extern "C" void vector(void)
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define ISR_ALIASOF(vector)
+#define reti()
+
+// The library's hooks for register accesses the model can't see in memory alone.
+#define PTO_MODEL_WRITE(reg) hostModel::registerWritten(reg)
+#define PTO_MODEL_READ(reg) hostModel::registerRead(reg)
+
+// --- Flash ---
+// Program memory is ordinary memory on the host.
+inline uint8_t pgm_read_byte(const void* address) { return *(const uint8_t*)address; }
+inline uint16_t pgm_read_word(const void* address) { return *(const uint16_t*)address; }
+inline uint32_t pgm_read_dword(const void* address) { return *(const uint32_t*)address; }
+
+// --- Registers ---
+#define PTO_HOST_REG8(name) extern volatile uint8_t name;
+#define PTO_HOST_REG16(name) extern volatile uint16_t name;
+#include "hostRegisters.h"
+#undef PTO_HOST_REG8
+#undef PTO_HOST_REG16
+
+// Timer bit positions. Each 16-bit timer uses the same positions as Timer1.
+enum {
+    WGM10 = 0, WGM11 = 1, COM1C0 = 2, COM1C1 = 3, COM1B0 = 4, COM1B1 = 5, COM1A0 = 6, COM1A1 = 7,
+    CS10 = 0, CS11 = 1, CS12 = 2, WGM12 = 3, WGM13 = 4, ICES1 = 6, ICNC1 = 7,
+    FOC1C = 5, FOC1B = 6, FOC1A = 7,
+    TOIE1 = 0, OCIE1A = 1, OCIE1B = 2, OCIE1C = 3, ICIE1 = 5,
+    TOV1 = 0, OCF1A = 1, OCF1B = 2, OCF1C = 3, ICF1 = 5,
+    WGM20 = 0, WGM21 = 1, COM2B0 = 4, COM2B1 = 5, COM2A0 = 6, COM2A1 = 7,
+    CS20 = 0, CS21 = 1, CS22 = 2, WGM22 = 3, FOC2B = 6, FOC2A = 7,
+    TOIE2 = 0, OCIE2A = 1, OCIE2B = 2, TOV2 = 0, OCF2A = 1, OCF2B = 2,
+    PSRSYNC = 0, PSR10 = 0, PSRASY = 1, PSR2 = 1, TSM = 7
+};
+#if defined(__AVR_ATmega2560__)
+#define PTO_HOST_TIMER_BITS(n)                                                                  \
+    WGM##n##0 = 0, WGM##n##1 = 1, COM##n##C0 = 2, COM##n##C1 = 3, COM##n##B0 = 4, COM##n##B1 = 5, \
+    COM##n##A0 = 6, COM##n##A1 = 7, CS##n##0 = 0, CS##n##1 = 1, CS##n##2 = 2, WGM##n##2 = 3,    \
+    WGM##n##3 = 4, FOC##n##C = 5, FOC##n##B = 6, FOC##n##A = 7, TOIE##n = 0, OCIE##n##A = 1,    \
+    OCIE##n##B = 2, OCIE##n##C = 3, TOV##n = 0, OCF##n##A = 1, OCF##n##B = 2, OCF##n##C = 3
+enum { PTO_HOST_TIMER_BITS(3) };
+enum { PTO_HOST_TIMER_BITS(4) };
+enum { PTO_HOST_TIMER_BITS(5) };
+#undef PTO_HOST_TIMER_BITS
+#endif
+
+// Port bit positions.
+#define PTO_HOST_PORT_BITS(p) P##p##0 = 0, P##p##1, P##p##2, P##p##3, P##p##4, P##p##5, P##p##6, P##p##7
+enum { PTO_HOST_PORT_BITS(B) };
+enum { PTO_HOST_PORT_BITS(C) };
+enum { PTO_HOST_PORT_BITS(D) };
+#if defined(__AVR_ATmega2560__)
+enum { PTO_HOST_PORT_BITS(A) };
+enum { PTO_HOST_PORT_BITS(E) };
+enum { PTO_HOST_PORT_BITS(G) };
+enum { PTO_HOST_PORT_BITS(H) };
+enum { PTO_HOST_PORT_BITS(J) };
+enum { PTO_HOST_PORT_BITS(L) };
+#endif
+#undef PTO_HOST_PORT_BITS
+
+// --- Digital I/O ---
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t* portOutputRegister(uint8_t port);
+volatile uint8_t* portInputRegister(uint8_t port);
+volatile uint8_t* portModeRegister(uint8_t port);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// --- Time ---
+// Each call costs the model the cycles the real one takes, so a sketch that polls them moves on.
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// --- Serial ---
+// Prints to stdout.
+class HardwareSerial {
+public:
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+    size_t print(const char* text);
+    size_t print(char c);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(double value, int digits = 2);
+    size_t println() { return print("\n"); }
+    template <class T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <class T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,2 @@
+// ISR() and SREG live in the host Arduino.h.
+#include "../Arduino.h"
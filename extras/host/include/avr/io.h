@@ -0,0 +1,2 @@
+// The host registers live in Arduino.h.
+#include "../Arduino.h"
@@ -0,0 +1,2 @@
+// Flash access lives in the host Arduino.h.
+#include "../Arduino.h"
@@ -0,0 +1,141 @@
+/**
+ * @file hostModel.h
+ * @brief A cycle-stepped model of the AVR timers, pins and interrupt controller, for running
+ * jct_pulseTrainOutput on a PC. Time only moves inside the model: run(), the host core's
+ * delay()/micros()/millis(), and counter reads in the library's busy-waits. Everything else a
+ * sketch does takes no time, so an interrupt can only land where the model is stepped.
+ * Timer0 isn't modelled, and the R4 isn't modelled at all.
+ */
+#ifndef HOSTMODEL_H
+#define HOSTMODEL_H
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+namespace hostModel {
+
+/**
+ * @brief One change of level on a pin.
+ */
+struct edge {
+    uint64_t cycle;     // CPU cycles since reset().
+    uint8_t pin;        // Arduino pin number.
+    uint8_t level;      // HIGH or LOW after the change.
+};
+
+/**
+ * @brief Cycle counts of the library's hand-written compare vector, from the compare match to the
+ * instruction after reti. tests/cycles.cpp counts them from the assembly in pulseTrainOutput.cpp.
+ * The Mega's 3-byte return address adds a cycle to entry, to reti and to call; Timer2's 8-bit
+ * OCR2A takes one store instead of two.
+ */
+struct vectorCycles {
+    uint16_t fast;          // ptoFastCount was not yet 0.
+    uint16_t finish;        // The fast path's last toggle, switching the output to "Clear".
+    uint16_t reload;        // ptoFastCount refilled from ptoFastReload.
+    uint16_t play;          // One playback entry loaded into OCRnA.
+    uint16_t playStore;     // When, within play, the entry reaches OCRnA.
+    uint16_t playLast;      // The last entry of a pass, with ptoFinish clear.
+    uint16_t playFinish;    // The last entry of the train, switching the output to "Clear".
+    uint16_t slowCall;      // From the compare match to the first instruction of ptoCompareN().
+    uint16_t slowReturn;    // From ptoCompareN()'s ret to the instruction after reti.
+};
+#if defined(__AVR_ATmega2560__)
+const vectorCycles vector16 = {39, 58, 73, 79, 54, 89, 96, 84, 41};
+const vectorCycles vector8 = {39, 58, 73, 77, 52, 87, 94, 84, 41};
+#else
+const vectorCycles vector16 = {37, 56, 71, 77, 53, 87, 94, 79, 37};
+const vectorCycles vector8 = {37, 56, 71, 75, 51, 85, 92, 79, 37};
+#endif
+
+/**
+ * @brief Estimates for the code the model can't count. handlerCycles is the C side of an interrupt
+ * (ptoCompareN() and handleInterrupt(), or a whole C vector such as TIMER1_OVF_vect), and
+ * prologueCycles is how far into a C vector its body starts. timeCallCycles is the cost of one
+ * micros() or millis() call, and pollCycles of a yield() or a pass of an empty loop().
+ */
+extern uint16_t handlerCycles;
+extern uint16_t prologueCycles;
+extern uint16_t timeCallCycles;
+extern uint16_t pollCycles;
+
+/**
+ * @brief Powers the model up: registers and time to 0, interrupts enabled, no edges or wires.
+ */
+void reset();
+
+/**
+ * @brief The CPU cycles since reset().
+ */
+uint64_t now();
+
+/**
+ * @brief Runs the sketch for a number of CPU cycles, entering interrupts while SREG's I bit is set.
+ * The cycles an interrupt takes are added on top, as they would hold up the sketch's code.
+ */
+void run(uint64_t cycles);
+
+/**
+ * @brief Runs the model until done() returns true, checking it every cycle.
+ * @return false if maxCycles passed first.
+ */
+template <class condition>
+bool runUntil(condition done, uint64_t maxCycles) {
+    uint64_t end = now() + maxCycles;
+    while (!done()) {
+        if (now() >= end) {
+            return false;
+        }
+        run(1);
+    }
+    return true;
+}
+
+/**
+ * @brief Wires one pin to another, as a jumper would. The input follows the output from then on,
+ * so a timer clocked from its Tn pin counts the output's edges.
+ */
+void wire(uint8_t from, uint8_t to);
+
+/**
+ * @brief Turns the edge log on or off. It is on after reset(); a long run may not want it.
+ */
+void recordEdges(bool on);
+
+/**
+ * @brief Every edge since reset(), in order.
+ */
+const std::vector<edge>& edges();
+
+/**
+ * @brief The cycles at which a pin rose.
+ */
+std::vector<uint64_t> rises(uint8_t pin);
+
+/**
+ * @brief Prints the edges as CSV, "cycle,pin,level", one per line.
+ */
+void printEdges(FILE* out);
+
+/**
+ * @brief The interrupts entered since reset(), and the CPU cycles they took.
+ */
+uint32_t interruptCount();
+uint64_t interruptCycles();
+
+/**
+ * @brief Brings the pins up to date with the registers without moving time, as a read would.
+ */
+void sync();
+
+/**
+ * @brief The hooks behind PTO_MODEL_WRITE and PTO_MODEL_READ. A write to TIFRn clears the flags
+ * written as one, a write to PINx toggles those PORTx bits, and a write to TCNTn blocks the next
+ * compare match. A read of TCNTn takes a cycle, so a loop waiting on the counter sees it move.
+ */
+void registerWritten(volatile void* reg);
+void registerRead(volatile void* reg);
+
+}
+
+#endif
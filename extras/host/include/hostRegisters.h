@@ -0,0 +1,25 @@
+// The I/O registers the host core provides, as PTO_HOST_REG8/PTO_HOST_REG16(name). Included twice:
+// by Arduino.h to declare them and by hostCore.cpp to define them.
+PTO_HOST_REG8(GTCCR)
+PTO_HOST_REG8(TCCR1A) PTO_HOST_REG8(TCCR1B) PTO_HOST_REG8(TCCR1C) PTO_HOST_REG8(TIMSK1) PTO_HOST_REG8(TIFR1)
+PTO_HOST_REG16(TCNT1) PTO_HOST_REG16(OCR1A) PTO_HOST_REG16(OCR1B) PTO_HOST_REG16(ICR1)
+PTO_HOST_REG8(TCCR2A) PTO_HOST_REG8(TCCR2B) PTO_HOST_REG8(TIMSK2) PTO_HOST_REG8(TIFR2) PTO_HOST_REG8(ASSR)
+PTO_HOST_REG8(TCNT2) PTO_HOST_REG8(OCR2A) PTO_HOST_REG8(OCR2B)
+PTO_HOST_REG8(PORTB) PTO_HOST_REG8(PINB) PTO_HOST_REG8(DDRB)
+PTO_HOST_REG8(PORTC) PTO_HOST_REG8(PINC) PTO_HOST_REG8(DDRC)
+PTO_HOST_REG8(PORTD) PTO_HOST_REG8(PIND) PTO_HOST_REG8(DDRD)
+#if defined(__AVR_ATmega2560__)
+PTO_HOST_REG16(OCR1C)
+PTO_HOST_REG8(TCCR3A) PTO_HOST_REG8(TCCR3B) PTO_HOST_REG8(TCCR3C) PTO_HOST_REG8(TIMSK3) PTO_HOST_REG8(TIFR3)
+PTO_HOST_REG16(TCNT3) PTO_HOST_REG16(OCR3A) PTO_HOST_REG16(OCR3B) PTO_HOST_REG16(OCR3C) PTO_HOST_REG16(ICR3)
+PTO_HOST_REG8(TCCR4A) PTO_HOST_REG8(TCCR4B) PTO_HOST_REG8(TCCR4C) PTO_HOST_REG8(TIMSK4) PTO_HOST_REG8(TIFR4)
+PTO_HOST_REG16(TCNT4) PTO_HOST_REG16(OCR4A) PTO_HOST_REG16(OCR4B) PTO_HOST_REG16(OCR4C) PTO_HOST_REG16(ICR4)
+PTO_HOST_REG8(TCCR5A) PTO_HOST_REG8(TCCR5B) PTO_HOST_REG8(TCCR5C) PTO_HOST_REG8(TIMSK5) PTO_HOST_REG8(TIFR5)
+PTO_HOST_REG16(TCNT5) PTO_HOST_REG16(OCR5A) PTO_HOST_REG16(OCR5B) PTO_HOST_REG16(OCR5C) PTO_HOST_REG16(ICR5)
+PTO_HOST_REG8(PORTA) PTO_HOST_REG8(PINA) PTO_HOST_REG8(DDRA)
+PTO_HOST_REG8(PORTE) PTO_HOST_REG8(PINE) PTO_HOST_REG8(DDRE)
+PTO_HOST_REG8(PORTG) PTO_HOST_REG8(PING) PTO_HOST_REG8(DDRG)
+PTO_HOST_REG8(PORTH) PTO_HOST_REG8(PINH) PTO_HOST_REG8(DDRH)
+PTO_HOST_REG8(PORTJ) PTO_HOST_REG8(PINJ) PTO_HOST_REG8(DDRJ)
+PTO_HOST_REG8(PORTL) PTO_HOST_REG8(PINL) PTO_HOST_REG8(DDRL)
+#endif
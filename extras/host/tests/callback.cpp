@@ -0,0 +1,51 @@
+/**
+ * @file callback.cpp
+ * @brief A completion callback runs inside the interrupt, so the calls it may make must leave
+ * interrupts disabled when they return.
+ */
+#include "hostTest.h"
+#include "pulseTrainOutput.h"
+
+HOST_TEST_MAIN
+
+#if defined(__AVR_ATmega2560__)
+const uint8_t pin = 11;
+#else
+const uint8_t pin = 9;
+#endif
+
+static bool called;
+static bool enabledAfter;               // Any call in the callback left SREG's I bit set.
+
+static void complete(pulseTrainOutput& output) {
+    called = true;
+    output.getPosition();
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+    output.getPulsesEmitted();
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+    output.getFrequencyError();
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+    output.pollComplete();
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+    output.onComplete(complete);
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+#if PTO_ENABLE_STATISTICS
+    pulseTrainStatistics stats;
+    output.getStatistics(stats);
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+    output.resetStatistics();
+    enabledAfter = enabledAfter || (SREG & _BV(SREG_I));
+#endif
+}
+
+int main() {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    output.onComplete(complete);
+    CHECK(SREG & _BV(SREG_I));
+    CHECK(output.generate(1000, DISCRETE, 3));
+    CHECK(hostModel::runUntil([&] { return called; }, F_CPU / 100));
+    CHECK(!enabledAfter);
+    CHECK(SREG & _BV(SREG_I));
+    return hostTest::finish("callback");
+}
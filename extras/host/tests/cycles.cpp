@@ -0,0 +1,413 @@
+/**
+ * @file cycles.cpp
+ * @brief Counts the cycles of the hand-written compare vector from its assembly. The asm text of
+ * PTO_COMPARE_VECTOR is read out of pulseTrainOutput.cpp and run on a small AVR interpreter,
+ * once for each path, and the counts must match hostModel.h's vectorCycles and the comment above
+ * the macro. The interpreter also checks what each path leaves behind, so the assembly is held
+ * to the same behaviour as the C version the model runs.
+ */
+#include "hostTest.h"
+#include <map>
+#include <string>
+#include <vector>
+
+HOST_TEST_MAIN
+
+namespace {
+
+const char sourcePath[] = "../../src/pulseTrainOutput.cpp";
+
+#if defined(__AVR_ATmega2560__)
+const bool bigPc = true;            // 3-byte return address: entry, call and reti take a cycle more.
+#else
+const bool bigPc = false;
+#endif
+
+std::string source;
+
+std::string readFile(const char* path) {
+    std::string text;
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        perror(path);
+        return text;
+    }
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, n);
+    }
+    fclose(file);
+    return text;
+}
+
+// The body of the first #define of 'name', with its line continuations.
+std::string macroBody(const std::string& name, std::vector<std::string>* params = nullptr) {
+    size_t start = source.find("#define " + name);
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += 8 + name.size();
+    size_t end = start;
+    while (end < source.size() && !(source[end] == '\n' && source[end - 1] != '\\')) {
+        end++;
+    }
+    std::string body = source.substr(start, end - start);
+    if (!body.empty() && body[0] == '(' && params != nullptr) {
+        size_t close = body.find(')');
+        std::string list = body.substr(1, close - 1);
+        size_t from = 0;
+        while (from <= list.size()) {
+            size_t comma = list.find(',', from);
+            std::string param = list.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+            param.erase(0, param.find_first_not_of(" "));
+            param.erase(param.find_last_not_of(" ") + 1);
+            params->push_back(param);
+            if (comma == std::string::npos) {
+                break;
+            }
+            from = comma + 1;
+        }
+        body = body.substr(close + 1);
+    }
+    return body;
+}
+
+// Concatenates the string literals in 'text' from 'pos' to the first unmatched ')', as the
+// compiler would, replacing identifiers from 'names' and skipping comments.
+std::string literals(const std::string& text, size_t pos, const std::map<std::string, std::string>& names) {
+    std::string out;
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (c == '/' && text.compare(pos, 2, "/*") == 0) {
+            pos = text.find("*/", pos) + 2;
+        } else if (c == '"') {
+            for (pos++; text[pos] != '"'; pos++) {
+                if (text[pos] == '\\') {
+                    pos++;
+                    out += text[pos] == 'n' ? '\n' : (text[pos] == 't' ? '\t' : text[pos]);
+                } else {
+                    out += text[pos];
+                }
+            }
+            pos++;
+        } else if (c == '#' || isalpha((unsigned char)c) || c == '_') {
+            size_t end = pos + 1;
+            while (end < text.size() && (isalnum((unsigned char)text[end]) || text[end] == '_')) {
+                end++;
+            }
+            std::map<std::string, std::string>::const_iterator name = names.find(text.substr(pos, end - pos));
+            if (name != names.end()) {
+                out += name->second;
+            }
+            pos = end;
+        } else if (c == ')') {
+            break;
+        } else {
+            pos++;
+        }
+    }
+    return out;
+}
+
+// A string macro such as PTO_STORE_OCR16("0x88"), expanded.
+std::string expandStringMacro(const std::string& name, const std::string& argument) {
+    std::vector<std::string> params;
+    std::string body = macroBody(name, &params);
+    std::map<std::string, std::string> names;
+    if (!params.empty()) {
+        names[params[0]] = argument;
+    }
+    return literals(body + ")", 0, names);
+}
+
+// --- The interpreter ---
+
+struct machine {
+    uint8_t r[32];
+    bool carry;
+    bool zero;
+    std::vector<uint8_t> stack;
+    std::map<std::string, std::vector<uint8_t> > symbols;
+    std::map<uint32_t, uint8_t> io;
+    std::vector<uint8_t> flash;
+    uint32_t cycles;
+    uint32_t called;        // Cycle count when 'call' finished, or 0.
+    uint32_t lastIoStore;   // Cycle count when the last store to a numeric address finished.
+};
+
+uint32_t evaluate(const std::string& expression) {
+    // Sums of products of integers, as the operands use: "2*3+1".
+    uint32_t sum = 0;
+    size_t from = 0;
+    while (from < expression.size()) {
+        size_t plus = expression.find('+', from);
+        std::string term = expression.substr(from, plus == std::string::npos ? std::string::npos : plus - from);
+        uint32_t product = 1;
+        size_t f = 0;
+        while (f <= term.size()) {
+            size_t star = term.find('*', f);
+            product *= strtoul(term.substr(f, star == std::string::npos ? std::string::npos : star - f).c_str(), nullptr, 0);
+            if (star == std::string::npos) {
+                break;
+            }
+            f = star + 1;
+        }
+        sum += product;
+        if (plus == std::string::npos) {
+            break;
+        }
+        from = plus + 1;
+    }
+    return sum;
+}
+
+uint8_t* memory(machine& m, const std::string& operand) {
+    size_t plus = operand.find('+');
+    std::string base = operand.substr(0, plus);
+    uint32_t offset = plus == std::string::npos ? 0 : evaluate(operand.substr(plus + 1));
+    if (isdigit((unsigned char)base[0])) {
+        return &m.io[evaluate(base) + offset];
+    }
+    std::vector<uint8_t>& bytes = m.symbols[base];
+    if (bytes.size() <= offset) {
+        bytes.resize(offset + 1);
+    }
+    return &bytes[offset];
+}
+
+uint8_t reg(const std::string& operand) {
+    return (uint8_t)strtoul(operand.c_str() + 1, nullptr, 10);
+}
+
+std::vector<std::string> program;
+
+// Runs the vector from entry to reti.
+void execute(machine& m) {
+    m.cycles = bigPc ? 5 + 3 : 4 + 3;
+    m.called = 0;
+    m.lastIoStore = 0;
+    for (size_t pc = 0; pc < program.size(); pc++) {
+        const std::string& line = program[pc];
+        if (line[line.size() - 1] == ':') {
+            continue;
+        }
+        std::string op = line.substr(0, line.find(' '));
+        std::string a;
+        std::string b;
+        if (line.find(' ') != std::string::npos) {
+            std::string operands = line.substr(line.find(' ') + 1);
+            size_t comma = operands.find(',');
+            a = operands.substr(0, comma);
+            if (comma != std::string::npos) {
+                b = operands.substr(operands.find_first_not_of(' ', comma + 1));
+            }
+        }
+        bool jump = false;
+        if (op == "push") {
+            m.stack.push_back(m.r[reg(a)]);
+            m.cycles += 2;
+        } else if (op == "pop") {
+            m.r[reg(a)] = m.stack.back();
+            m.stack.pop_back();
+            m.cycles += 2;
+        } else if (op == "in") {
+            m.r[reg(a)] = 0;
+            m.cycles += 1;
+        } else if (op == "out") {
+            m.cycles += 1;
+        } else if (op == "lds") {
+            m.r[reg(a)] = *memory(m, b);
+            m.cycles += 2;
+        } else if (op == "sts") {
+            *memory(m, a) = m.r[reg(b)];
+            m.cycles += 2;
+            if (isdigit((unsigned char)a[0])) {
+                m.lastIoStore = m.cycles;
+            }
+        } else if (op == "sbiw") {
+            uint16_t value = m.r[reg(a)] | m.r[reg(a) + 1] << 8;
+            uint16_t k = (uint16_t)evaluate(b);
+            m.carry = value < k;
+            value -= k;
+            m.zero = value == 0;
+            m.r[reg(a)] = value & 0xFF;
+            m.r[reg(a) + 1] = value >> 8;
+            m.cycles += 2;
+        } else if (op == "cp" || op == "cpc") {
+            int borrow = op == "cpc" && m.carry ? 1 : 0;
+            int result = m.r[reg(a)] - m.r[reg(b)] - borrow;
+            m.zero = (op == "cpc" ? m.zero : true) && (result & 0xFF) == 0;
+            m.carry = result < 0;
+            m.cycles += 1;
+        } else if (op == "or" || op == "andi" || op == "ori" || op == "ldi" || op == "clr" || op == "tst") {
+            uint8_t& d = m.r[reg(a)];
+            if (op == "or") d |= m.r[reg(b)];
+            if (op == "andi") d &= evaluate(b);
+            if (op == "ori") d |= evaluate(b);
+            if (op == "ldi") d = evaluate(b);
+            if (op == "clr") d = 0;
+            if (op != "ldi") m.zero = d == 0;
+            m.cycles += 1;
+        } else if (op == "lpm") {
+            uint16_t z = m.r[30] | m.r[31] << 8;
+            m.r[reg(a)] = m.flash[z];
+            z++;
+            m.r[30] = z & 0xFF;
+            m.r[31] = z >> 8;
+            m.cycles += 3;
+        } else if (op == "brcs" || op == "breq" || op == "brne") {
+            jump = op == "brcs" ? m.carry : (op == "breq" ? m.zero : !m.zero);
+            m.cycles += jump ? 2 : 1;
+        } else if (op == "rjmp") {
+            jump = true;
+            m.cycles += 2;
+        } else if (op == "call") {
+            m.cycles += bigPc ? 5 : 4;
+            m.called = m.cycles;              // ptoCompareN() itself is the handler's cost.
+        } else if (op == "reti") {
+            m.cycles += bigPc ? 5 : 4;
+            return;
+        } else {
+            printf("unknown instruction '%s'\n", line.c_str());
+            hostTest::failures++;
+            return;
+        }
+        if (jump) {
+            const std::string& label = a;
+            std::string target = label.substr(0, label.size() - 1) + ":";
+            if (label[label.size() - 1] == 'f') {
+                while (program[++pc] != target) {}
+            } else {
+                while (program[--pc] != target) {}
+            }
+        }
+    }
+    printf("the vector ran off its end\n");
+    hostTest::failures++;
+}
+
+uint16_t word(machine& m, const char* symbol, uint8_t id) {
+    return *memory(m, std::string(symbol) + "+" + std::to_string(2 * id)) |
+           *memory(m, std::string(symbol) + "+" + std::to_string(2 * id + 1)) << 8;
+}
+
+void setWord(machine& m, const char* symbol, uint8_t id, uint16_t value) {
+    *memory(m, std::string(symbol) + "+" + std::to_string(2 * id)) = value & 0xFF;
+    *memory(m, std::string(symbol) + "+" + std::to_string(2 * id + 1)) = value >> 8;
+}
+
+struct scenario {
+    uint16_t count;
+    uint16_t reload;
+    uint8_t finish;
+    uint8_t playEntries;    // Entries left in the table, 0 for none.
+};
+
+const uint8_t id = 0;
+const uint32_t tccrAddress = 0x80;
+const uint16_t tableAddress = 0x200;
+const uint16_t tableEntry = 1234;
+
+machine runScenario(const scenario& s) {
+    machine m;
+    memset(m.r, 0, sizeof(m.r));
+    m.carry = false;
+    m.zero = false;
+    m.flash.assign(0x400, 0);
+    for (uint16_t i = 0; i < 8; i++) {
+        m.flash[tableAddress + 2 * i] = (tableEntry + i) & 0xFF;
+        m.flash[tableAddress + 2 * i + 1] = (tableEntry + i) >> 8;
+    }
+    setWord(m, "ptoFastCount", id, s.count);
+    setWord(m, "ptoFastReload", id, s.reload);
+    *memory(m, "ptoFinish+0") = s.finish;
+    setWord(m, "ptoPlayNext", id, tableAddress);
+    setWord(m, "ptoPlayEnd", id, tableAddress + 2 * s.playEntries);
+    m.io[tccrAddress] = 0x40;                 // Toggle on compare.
+    execute(m);
+    CHECK(m.stack.empty());
+    return m;
+}
+
+}
+
+int main() {
+    source = readFile(sourcePath);
+    CHECK(!source.empty());
+
+    // The assembly variant of PTO_COMPARE_VECTOR comes first in the file.
+    std::string vector = macroBody("PTO_COMPARE_VECTOR");
+    size_t asmStart = vector.find("asm volatile(");
+    CHECK(asmStart != std::string::npos);
+    if (asmStart == std::string::npos) {
+        return hostTest::finish("cycles");
+    }
+    std::map<std::string, std::string> names;
+    names["#id"] = std::to_string(id);
+    names["tccrAddress"] = "0x80";
+    names["PTO_PUSH_RAMPZ"] = bigPc ? expandStringMacro("PTO_PUSH_RAMPZ", "") : "";
+    names["PTO_POP_RAMPZ"] = bigPc ? expandStringMacro("PTO_POP_RAMPZ", "") : "";
+
+    for (uint8_t width = 0; width < 2; width++) {
+        bool is16bit = width == 0;
+        names["storeOcr"] = expandStringMacro(is16bit ? "PTO_STORE_OCR16" : "PTO_STORE_OCR8", "0x88");
+        std::string text = literals(vector, asmStart + 13, names);
+        program.clear();
+        size_t from = 0;
+        while (from < text.size()) {
+            size_t end = text.find('\n', from);
+            std::string line = text.substr(from, end - from);
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t") + 1);
+            if (!line.empty()) {
+                program.push_back(line);
+            }
+            from = end == std::string::npos ? text.size() : end + 1;
+        }
+
+        const hostModel::vectorCycles& expected = is16bit ? hostModel::vector16 : hostModel::vector8;
+        const char* name = is16bit ? "16-bit" : "Timer2";
+
+        machine fast = runScenario({5, 0, 1, 0});
+        CHECK(word(fast, "ptoFastCount", id) == 4);
+        CHECK(fast.io[tccrAddress] == 0x40);
+
+        machine finish = runScenario({1, 0, 1, 0});
+        CHECK(word(finish, "ptoFastCount", id) == 0);
+        CHECK(finish.io[tccrAddress] == 0x80);        // Switched to "Clear".
+
+        machine reload = runScenario({0, 3, 0, 0});
+        CHECK(word(reload, "ptoFastCount", id) == 0xFFFF);
+        CHECK(word(reload, "ptoFastReload", id) == 2);
+
+        machine play = runScenario({0, 0, 1, 2});
+        CHECK(word(play, "ptoPlayNext", id) == tableAddress + 2);
+        uint16_t stored = play.io[0x88] | (is16bit ? play.io[0x89] << 8 : 0);
+        CHECK(stored == (uint16_t)((tableEntry - 1) & (is16bit ? 0xFFFF : 0xFF)));
+        CHECK(play.io[tccrAddress] == 0x40);
+
+        machine playLast = runScenario({0, 0, 0, 1});
+        CHECK(playLast.io[tccrAddress] == 0x40);
+
+        machine playFinish = runScenario({0, 0, 1, 1});
+        CHECK(playFinish.io[tccrAddress] == 0x80);
+
+        machine slow = runScenario({0, 0, 0, 0});
+        CHECK(slow.called != 0);
+
+        printf("%s: fast %u, finish %u, reload %u, play %u (store at %u), last %u, finishing %u, "
+               "call at %u, return %u\n", name, fast.cycles, finish.cycles, reload.cycles, play.cycles,
+               play.lastIoStore, playLast.cycles, playFinish.cycles, slow.called, slow.cycles - slow.called);
+        CHECK(fast.cycles == expected.fast);
+        CHECK(finish.cycles == expected.finish);
+        CHECK(reload.cycles == expected.reload);
+        CHECK(play.cycles == expected.play);
+        CHECK(play.lastIoStore == expected.playStore);
+        CHECK(playLast.cycles == expected.playLast);
+        CHECK(playFinish.cycles == expected.playFinish);
+        CHECK(slow.called == expected.slowCall);
+        CHECK(slow.cycles - slow.called == expected.slowReturn);
+    }
+    return hostTest::finish("cycles");
+}
@@ -0,0 +1,109 @@
+/**
+ * @file group.cpp
+ * @brief pulseTrainGroup starts and updates its members on the same clock, including at
+ * frequencies where generate() alone would run the timer on clk/1, which GTCCR can't hold.
+ */
+#include "hostTest.h"
+#include "pulseTrainOutput.h"
+
+HOST_TEST_MAIN
+
+#if defined(__AVR_ATmega2560__)
+pulseTrainOutput ch0(11), ch1(10), ch2(5), ch3(6), ch4(46);
+pulseTrainOutput* channels[] = {&ch0, &ch1, &ch2, &ch3, &ch4};
+const uint8_t pins[] = {11, 10, 5, 6, 46};
+#else
+pulseTrainOutput ch0(9), ch1(11);
+pulseTrainOutput* channels[] = {&ch0, &ch1};
+const uint8_t pins[] = {9, 11};
+#endif
+const uint8_t channelCount = sizeof(channels) / sizeof(channels[0]);
+
+// Every member's rises land on the same cycles as the first member's.
+static bool aligned() {
+    std::vector<uint64_t> reference = hostModel::rises(pins[0]);
+    for (uint8_t i = 1; i < channelCount; i++) {
+        std::vector<uint64_t> rises = hostModel::rises(pins[i]);
+        for (size_t n = 0; n < rises.size() || n < reference.size(); n++) {
+            if (n >= rises.size() || n >= reference.size() || rises[n] != reference[n]) {
+                printf("pin %u: rise %u is not with pin %u's\n", pins[i], (unsigned)n, pins[0]);
+                return false;
+            }
+        }
+    }
+    return !reference.empty();
+}
+
+static void starts(uint32_t frequency) {
+    hostModel::reset();
+    pulseTrainGroup group;
+    for (uint8_t i = 0; i < channelCount; i++) {
+        CHECK(group.add(*channels[i]));
+    }
+    CHECK(group.generate(frequency, DISCRETE, 20));
+    for (uint8_t i = 0; i < channelCount; i++) {
+        CHECK(group.getSkew(i) > -8 && group.getSkew(i) < 8);    // Within a count at /8, its resolution.
+    }
+    CHECK(hostModel::runUntil([&] { return !ch0.isRunning(); }, 21 * F_CPU / frequency));
+    hostModel::run(F_CPU / 1000);
+    CHECK(aligned());
+    CHECK(hostModel::rises(pins[0]).size() == 20);
+}
+
+// The model runs sketch code in no time, so only the counter reads in updateFrequency() would let
+// a clk/1 member run ahead of the held ones.
+static void updates() {
+    hostModel::reset();
+    pulseTrainGroup group;
+    uint32_t frequencies[PTO_GROUP_SIZE];
+    for (uint8_t i = 0; i < channelCount; i++) {
+        CHECK(group.add(*channels[i]));
+        frequencies[i] = 40000;
+    }
+    CHECK(group.generate(20000UL));
+    hostModel::run(F_CPU / 1000);
+    CHECK(group.updateFrequency(frequencies));
+    hostModel::run(F_CPU / 1000);
+    CHECK(aligned());
+    group.stop();
+}
+
+// A faster frequency whose top the counters have already passed ends the half period within a
+// count or two, as a single channel's does, not a whole new half period later or after a wrap.
+static void updatesPastTop() {
+    hostModel::reset();
+    pulseTrainGroup group;
+    uint32_t frequencies[PTO_GROUP_SIZE];
+    for (uint8_t i = 0; i < channelCount; i++) {
+        CHECK(group.add(*channels[i]));
+        frequencies[i] = 20000;
+    }
+    CHECK(group.generate(1000UL));
+    hostModel::run(F_CPU / 1000 + F_CPU * 3 / 10000);     // 300us into a 500us half period.
+    uint64_t updated = hostModel::now();
+    CHECK(group.updateFrequency(frequencies));
+    hostModel::run(F_CPU / 1000);
+    const std::vector<hostModel::edge>& log = hostModel::edges();
+    for (uint8_t i = 0; i < channelCount; i++) {
+        uint64_t first = 0;
+        for (size_t n = 0; n < log.size() && first == 0; n++) {
+            if (log[n].pin == pins[i] && log[n].cycle >= updated) {
+                first = log[n].cycle;
+            }
+        }
+        if (first == 0 || first - updated > 32) {
+            printf("pin %u: first edge %llu cycles after the update\n", pins[i],
+                   (unsigned long long)(first - updated));
+        }
+        CHECK(first != 0 && first - updated <= 32);     // Two counts at /32, the slowest 1000Hz prescaler.
+    }
+    group.stop();
+}
+
+int main() {
+    starts(20000);                      // clk/1 on its own, /8 in a group.
+    starts(1000);                       // /8 on its own, so a group changes nothing.
+    updates();
+    updatesPastTop();
+    return hostTest::finish("group");
+}
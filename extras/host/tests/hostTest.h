@@ -0,0 +1,32 @@
+/**
+ * @file hostTest.h
+ * @brief The checks the host tests share. Each test is a program that exits non-zero on failure.
+ */
+#ifndef HOSTTEST_H
+#define HOSTTEST_H
+#include <Arduino.h>
+#include <stdio.h>
+
+namespace hostTest {
+
+extern int failures;
+
+inline void check(bool passed, const char* condition, const char* file, int line) {
+    if (!passed) {
+        printf("%s:%d: CHECK(%s) failed\n", file, line, condition);
+        failures++;
+    }
+}
+
+// Prints the verdict and gives main() its exit status.
+inline int finish(const char* name) {
+    printf("%s: %s\n", name, failures == 0 ? "passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
+
+}
+
+#define CHECK(condition) hostTest::check((condition), #condition, __FILE__, __LINE__)
+#define HOST_TEST_MAIN int hostTest::failures = 0;
+
+#endif
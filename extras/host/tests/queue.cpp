@@ -0,0 +1,79 @@
+/**
+ * @file queue.cpp
+ * @brief queue(): a segment follows a DISCRETE train with no gap, and any other running mode
+ * refuses it without disturbing the train.
+ */
+#include "hostTest.h"
+#include "pulseTrainOutput.h"
+
+HOST_TEST_MAIN
+
+#if defined(__AVR_ATmega2560__)
+const uint8_t pins[] = {11, 10};
+#else
+const uint8_t pins[] = {9, 11};
+#endif
+const uint8_t pinCount = sizeof(pins) / sizeof(pins[0]);
+
+static void follows(uint8_t pin) {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.generate(1000, DISCRETE, 3));
+    CHECK(output.queue(2000, 2));
+    CHECK(hostModel::runUntil([&] { return !output.isRunning(); }, F_CPU / 100));
+    hostModel::run(F_CPU / 1000);
+    std::vector<uint64_t> rises = hostModel::rises(pin);
+    CHECK(rises.size() == 5);
+    if (rises.size() == 5) {
+        CHECK(rises[3] - rises[2] <= F_CPU / 1000 + 1);     // No gap between the two.
+        CHECK(rises[4] - rises[3] == F_CPU / 2000);
+    }
+    CHECK(digitalRead(pin) == LOW);
+}
+
+static void refusedWhileContinuous(uint8_t pin) {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.generate(1000, CONTINUOUS));
+    CHECK(!output.queue(2000, 2));
+    CHECK(output.getError() == INVALID_MODE);
+    CHECK(output.queuedSegments() == 0);
+    hostModel::run(F_CPU / 100);
+    CHECK(output.isRunning());
+    output.stop();
+}
+
+// Playback's last entry switches the output to "Clear" from ptoFinish, so a refused queue() must leave it.
+static void refusedWhilePlaying(uint8_t pin) {
+    static const uint16_t table[] PROGMEM = {100, 50, 100, 50};
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.play(table, 4, 64));
+    CHECK(!output.queue(2000, 2));
+    CHECK(output.getError() == INVALID_MODE);
+    CHECK(hostModel::runUntil([&] { return output.isPlaybackDone(); }, F_CPU / 100));
+    hostModel::run(F_CPU / 1000);
+    CHECK(hostModel::rises(pin).size() == 2);
+    CHECK(digitalRead(pin) == LOW);
+}
+
+static void refusedWhileTracking(uint8_t pin) {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.track(1000));
+    CHECK(!output.queue(2000, 2));
+    CHECK(output.getError() == INVALID_MODE);
+    hostModel::run(F_CPU / 100);
+    CHECK(output.isRunning());
+    output.stop();
+}
+
+int main() {
+    for (uint8_t i = 0; i < pinCount; i++) {
+        follows(pins[i]);
+        refusedWhileContinuous(pins[i]);
+        refusedWhilePlaying(pins[i]);
+        refusedWhileTracking(pins[i]);
+    }
+    return hostTest::finish("queue");
+}
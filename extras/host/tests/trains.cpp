@@ -0,0 +1,118 @@
+/**
+ * @file trains.cpp
+ * @brief DISCRETE and CONTINUOUS trains on every timer: the pulse count, the period, the level a
+ * train ends at, a frequency change that lands on a period boundary, and one a MOVE must refuse.
+ */
+#include "hostTest.h"
+#include "pulseTrainOutput.h"
+
+HOST_TEST_MAIN
+
+#if defined(__AVR_ATmega2560__)
+const uint8_t pins[] = {11, 10, 5, 6, 46};
+#else
+const uint8_t pins[] = {9, 11};
+#endif
+const uint8_t pinCount = sizeof(pins) / sizeof(pins[0]);
+
+// Every rise of the pin is 'period' cycles after the one before, give or take 'slack'.
+static bool evenlySpaced(uint8_t pin, uint64_t period, uint64_t slack) {
+    std::vector<uint64_t> rises = hostModel::rises(pin);
+    for (size_t i = 1; i < rises.size(); i++) {
+        uint64_t gap = rises[i] - rises[i - 1];
+        if (gap + slack < period || gap > period + slack) {
+            printf("pin %u: rise %u is %llu cycles after the last, not %llu\n", pin, (unsigned)i,
+                   (unsigned long long)gap, (unsigned long long)period);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void discrete(uint8_t pin, uint32_t frequency, uint32_t pulses) {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.generate(frequency, DISCRETE, pulses));
+    uint64_t period = (uint64_t)(F_CPU / output.getActualFrequency() + 0.5);
+    CHECK(hostModel::runUntil([&] { return !output.isRunning(); }, (uint64_t)pulses * F_CPU / frequency + F_CPU / 100));
+    hostModel::run(F_CPU / frequency);
+    CHECK(hostModel::rises(pin).size() == pulses);
+    CHECK(evenlySpaced(pin, period, 1));
+    CHECK(digitalRead(pin) == LOW);
+}
+
+static void continuous(uint8_t pin) {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.generate(20000, CONTINUOUS));
+    hostModel::run(F_CPU / 100);
+    CHECK(evenlySpaced(pin, F_CPU / 20000, 1));
+    size_t before = hostModel::rises(pin).size();
+    CHECK(before >= 199 && before <= 201);
+
+    // The new period starts at a boundary, so no period comes out between the two.
+    CHECK(output.updateFrequency(10000));
+    hostModel::run(F_CPU / 100);
+    std::vector<uint64_t> rises = hostModel::rises(pin);
+    for (size_t i = before + 1; i < rises.size(); i++) {
+        uint64_t gap = rises[i] - rises[i - 1];
+        CHECK(gap == F_CPU / 20000 || gap == F_CPU / 10000);
+    }
+    CHECK(rises.back() - rises[rises.size() - 2] == F_CPU / 10000);
+    output.stop();
+    hostModel::run(F_CPU / 1000);
+    CHECK(digitalRead(pin) == LOW);
+}
+
+// Timer2 only reaches 5Hz by postscaling, which a MOVE can't do, so the update is refused and the move runs on.
+static void moveRefusesPostscale() {
+#if defined(__AVR_ATmega2560__)
+    const uint8_t pin = 10;
+#else
+    const uint8_t pin = 11;
+#endif
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.move(1000, 10000, 10000, 0));
+    CHECK(!output.updateFrequency(5));
+    CHECK(output.getError() == FREQUENCY_HIGH);
+    CHECK(output.getFrequencyError() == 0);
+    hostModel::run(F_CPU / 100);
+    CHECK(evenlySpaced(pin, F_CPU / 10000, 1));
+    output.stop();
+}
+
+// On Timer2, 20Hz is the 40Hz timing with a postscale of 2, so a target change that only changes
+// the postscale must still be applied.
+static void trackAcrossPostscale() {
+#if defined(__AVR_ATmega2560__)
+    const uint8_t pin = 10;
+#else
+    const uint8_t pin = 11;
+#endif
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.track(40));
+    hostModel::run(F_CPU / 10);
+    output.setTarget(20);
+    hostModel::run(F_CPU / 10);
+    size_t before = hostModel::rises(pin).size();
+    hostModel::run(F_CPU / 2);
+    CHECK(hostModel::rises(pin).size() - before == 10);
+    std::vector<uint64_t> rises = hostModel::rises(pin);
+    uint64_t gap = rises.back() - rises[rises.size() - 2];
+    CHECK(gap > F_CPU / 20 - F_CPU / 2000 && gap < F_CPU / 20 + F_CPU / 2000);     // Within 1%.
+    output.stop();
+}
+
+int main() {
+    for (uint8_t i = 0; i < pinCount; i++) {
+        discrete(pins[i], 1000, 5);
+        discrete(pins[i], 50000, 300);
+        discrete(pins[i], 7, 2);
+        continuous(pins[i]);
+    }
+    moveRefusesPostscale();
+    trackAcrossPostscale();
+    return hostTest::finish("trains");
+}
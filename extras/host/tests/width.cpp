@@ -0,0 +1,96 @@
+/**
+ * @file width.cpp
+ * @brief generateWidth() trains at a slow prescaler, where the overflow interrupt runs a whole
+ * count before BOTTOM: the pulse count, each pulse's width, and an updateWidth() that must change
+ * the period and the width at the same boundary.
+ */
+#include "hostTest.h"
+#include "pulseTrainOutput.h"
+
+HOST_TEST_MAIN
+
+#if defined(__AVR_ATmega2560__)
+const uint8_t pins[] = {11, 46};     // Timer1 and Timer5; 3 and 4 are the same code.
+#else
+const uint8_t pins[] = {9};
+#endif
+const uint8_t pinCount = sizeof(pins) / sizeof(pins[0]);
+
+struct pulse {
+    uint64_t rise;
+    uint64_t fall;
+};
+
+static std::vector<pulse> pulses(uint8_t pin) {
+    std::vector<pulse> found;
+    const std::vector<hostModel::edge>& log = hostModel::edges();
+    for (size_t i = 0; i < log.size(); i++) {
+        if (log[i].pin != pin) {
+            continue;
+        }
+        if (log[i].level == HIGH) {
+            found.push_back({log[i].cycle, 0});
+        } else if (!found.empty() && found.back().fall == 0) {
+            found.back().fall = log[i].cycle;
+        }
+    }
+    return found;
+}
+
+// 2Hz is too slow for /64, so generateWidth() takes /256 and the overflow comes 256 cycles before BOTTOM.
+static void discrete(uint8_t pin, uint32_t count) {
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.generateWidth(2, 100000000UL, DISCRETE, count));
+    CHECK(hostModel::runUntil([&] { return !output.isRunning(); }, (uint64_t)(count + 1) * F_CPU / 2));
+    hostModel::run(F_CPU);
+    std::vector<pulse> found = pulses(pin);
+    if (found.size() != count) {
+        printf("pin %u: %u pulses, not %u\n", pin, (unsigned)found.size(), (unsigned)count);
+    }
+    CHECK(found.size() == count);
+    for (size_t i = 0; i < found.size(); i++) {
+        CHECK(found[i].fall - found[i].rise == F_CPU / 10);
+    }
+    CHECK(digitalRead(pin) == LOW);
+}
+
+// Each period, from one falling edge to the next, must be wholly old or wholly new.
+static void update(uint8_t pin) {
+    const uint64_t oldPeriod = F_CPU / 2;
+    const uint64_t newPeriod = 20833ULL * 256;
+    hostModel::reset();
+    pulseTrainOutput output(pin);
+    CHECK(output.generateWidth(2, 100000000UL));
+    hostModel::run(F_CPU * 6 / 5);
+    CHECK(output.updateWidth(3, 50000000UL));
+    hostModel::run(F_CPU * 2);
+    std::vector<pulse> found = pulses(pin);
+    CHECK(found.size() >= 6);
+    bool changed = false;
+    for (size_t i = 1; i + 1 < found.size(); i++) {
+        uint64_t period = found[i].fall - found[i - 1].fall;
+        uint64_t width = found[i].fall - found[i].rise;
+        bool wholeOld = period == oldPeriod && width == F_CPU / 10;
+        bool wholeNew = period == newPeriod && width == F_CPU / 20;
+        if (!wholeOld && !wholeNew) {
+            printf("pin %u: period %u is %llu cycles with a %llu cycle pulse\n", pin, (unsigned)i,
+                   (unsigned long long)period, (unsigned long long)width);
+        }
+        CHECK(wholeOld || wholeNew);
+        CHECK(!(changed && wholeOld));
+        changed = changed || wholeNew;
+    }
+    CHECK(changed);
+    output.stop();
+}
+
+int main() {
+    for (uint8_t i = 0; i < pinCount; i++) {
+        discrete(pins[i], 1);
+        discrete(pins[i], 2);
+        discrete(pins[i], 3);
+        update(pins[i]);
+    }
+    return hostTest::finish("width");
+}
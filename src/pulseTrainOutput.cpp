@@ -66,6 +66,7 @@
 
 // Initialize the static array of pointers.
 pulseTrainOutput* pulseTrainOutput::_instances[10] = {nullptr};
+pulseTrainOutput* pulseTrainOutput::_counterOwner = nullptr;
 
 #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
 
@@ -115,14 +116,269 @@ static void (*r4_callbacks[])(timer_callback_args_t*) = {
 
 // --- AVR IMPLEMENTATION (UNO R3, MEGA, etc.) ---
 
-ISR(TIMER1_COMPA_vect) { if (pulseTrainOutput::_instances[TID_TIMER1] != nullptr) { pulseTrainOutput::_instances[TID_TIMER1]->handleInterrupt(); } }
-ISR(TIMER2_COMPA_vect) { if (pulseTrainOutput::_instances[TID_TIMER2] != nullptr) { pulseTrainOutput::_instances[TID_TIMER2]->handleInterrupt(); } }
+// --- Compare Vectors ---
+// The toggles each timer's vector counts by itself before handing back to handleInterrupt(), as
+// ptoFastReload * 65536 + ptoFastCount. Both at 0 turns the fast path off. When ptoFinish is set, the
+// last of those toggles is the rising edge of the train's final pulse, and the vector switches the
+// output to "Clear on Compare Match" itself. Indexed by timerIds.
+// During play(), ptoPlayNext walks the flash table towards ptoPlayEnd, one entry per toggle, and
+// the vector loads each into OCRnA. With ptoFinish set, the last entry switches the output to
+// "Clear" the same way. Equal pointers turn playback off.
+extern "C" {
+volatile uint16_t ptoFastCount[TID_TIMER5 + 1];
+volatile uint16_t ptoFastReload[TID_TIMER5 + 1];
+volatile uint8_t ptoFinish[TID_TIMER5 + 1];
+const uint16_t* volatile ptoPlayNext[TID_TIMER5 + 1];
+const uint16_t* volatile ptoPlayEnd[TID_TIMER5 + 1];
+}
+
+#if defined(__AVR__) && !defined(PTO_PORTABLE_ISR) && !PTO_ENABLE_STATISTICS
+#if defined(__AVR_HAVE_RAMPZ__)
+#define PTO_PUSH_RAMPZ "in r0, 0x3b\n\t" "push r0\n\t"
+#define PTO_POP_RAMPZ "pop r0\n\t" "out 0x3b, r0\n\t"
+#else
+#define PTO_PUSH_RAMPZ
+#define PTO_POP_RAMPZ
+#endif
+// The fast path decrements ptoFastCount and returns. It takes 37 cycles from the compare match to the
+// instruction after reti on the Uno (4 to enter, 3 for the vector jump, 26 in the body, 4 for reti)
+// and 39 on the Mega, whose 3-byte return address adds a cycle to entry and to reti. A reload adds
+// 34 cycles once per 65536 toggles, and finishing a train 19 once. A playback toggle takes 77 cycles
+// (79 on the Mega, 75 on Timer2). extras/host/tests/cycles.cpp counts these from the code below and
+// fails if they change. The slow path saves the registers a C call may clobber and calls
+// ptoCompareN(), which dispatches to handleInterrupt() as the vectors always did. tccrAddress is
+// TCCRnA's data space address; its COM bits sit where COM1A1/COM1A0 do on Timer1. storeOcr writes
+// r25:r24 to OCRnA, high byte first. Tables are read with lpm, so they must lie in the first 64KB.
+#define PTO_STORE_OCR16(address) "sts " address "+1, r25\n\t" "sts " address ", r24\n\t"
+#define PTO_STORE_OCR8(address) "sts " address ", r24\n\t"
+#define PTO_COMPARE_VECTOR(vector, id, tccrA, tccrAddress, ocr, storeOcr)           \
+    extern "C" void ptoCompare##id(void) {                                          \
+        if (pulseTrainOutput::_instances[id] != nullptr) {                          \
+            pulseTrainOutput::_instances[id]->handleInterrupt();                    \
+        }                                                                           \
+    }                                                                               \
+    ISR(vector, ISR_NAKED __attribute__((weak))) {                                  \
+        asm volatile(                                                               \
+            "push r24\n\t"                            /* 2 */                       \
+            "in r24, __SREG__\n\t"                    /* 1 */                       \
+            "push r24\n\t"                            /* 2 */                       \
+            "push r25\n\t"                            /* 2 */                       \
+            "lds r24, ptoFastCount+2*" #id "\n\t"     /* 2 */                       \
+            "lds r25, ptoFastCount+2*" #id "+1\n\t"   /* 2 */                       \
+            "sbiw r24, 1\n\t"                         /* 2 */                       \
+            "brcs 1f\n\t"                             /* 1: taken if it was 0 */    \
+            "sts ptoFastCount+2*" #id "+1, r25\n\t"   /* 2 */                       \
+            "sts ptoFastCount+2*" #id ", r24\n\t"     /* 2 */                       \
+            "breq 3f\n\t"                             /* 1: taken if now 0 */       \
+            "2:\n\t"                                                                \
+            "pop r25\n\t"                             /* 2 */                       \
+            "pop r24\n\t"                             /* 2 */                       \
+            "out __SREG__, r24\n\t"                   /* 1 */                       \
+            "pop r24\n\t"                             /* 2 */                       \
+            "reti\n\t"                                /* 4 */                       \
+            "3:\n\t"                                  /* The count ran out. */      \
+            "lds r24, ptoFastReload+2*" #id "\n\t"                                  \
+            "lds r25, ptoFastReload+2*" #id "+1\n\t"                                \
+            "or r24, r25\n\t"                                                       \
+            "brne 2b\n\t"                             /* The next one reloads. */   \
+            "lds r24, ptoFinish+" #id "\n\t"                                        \
+            "tst r24\n\t"                                                           \
+            "breq 2b\n\t"                                                           \
+            "lds r24, " tccrAddress "\n\t"                                          \
+            "andi r24, 0x3f\n\t"                      /* Clear COMnA1/COMnA0, */    \
+            "ori r24, 0x80\n\t"                       /* then set COMnA1. */        \
+            "sts " tccrAddress ", r24\n\t"                                          \
+            "rjmp 2b\n\t"                                                           \
+            "1:\n\t"                                  /* Play the next table entry. */ \
+            "push r30\n\t"                                                          \
+            "push r31\n\t"                                                          \
+            "lds r30, ptoPlayNext+2*" #id "\n\t"                                    \
+            "lds r31, ptoPlayNext+2*" #id "+1\n\t"                                  \
+            "lds r24, ptoPlayEnd+2*" #id "\n\t"                                     \
+            "lds r25, ptoPlayEnd+2*" #id "+1\n\t"                                   \
+            "cp r30, r24\n\t"                                                       \
+            "cpc r31, r25\n\t"                                                      \
+            "breq 5f\n\t"                             /* Not playing, or the pass is over. */ \
+            "lpm r24, Z+\n\t"                                                       \
+            "lpm r25, Z+\n\t"                                                       \
+            "sts ptoPlayNext+2*" #id "+1, r31\n\t"                                  \
+            "sts ptoPlayNext+2*" #id ", r30\n\t"                                    \
+            "sbiw r24, 1\n\t"                         /* n counts is OCR n - 1. */  \
+            storeOcr                                                                \
+            "lds r24, ptoPlayEnd+2*" #id "\n\t"                                     \
+            "lds r25, ptoPlayEnd+2*" #id "+1\n\t"                                   \
+            "cp r30, r24\n\t"                                                       \
+            "cpc r31, r25\n\t"                                                      \
+            "pop r31\n\t"                                                           \
+            "pop r30\n\t"                                                           \
+            "breq 3b\n\t"                             /* That was the last entry. */ \
+            "rjmp 2b\n\t"                                                           \
+            "5:\n\t"                                                                \
+            "pop r31\n\t"                                                           \
+            "pop r30\n\t"                             /* Reload from the upper word. */ \
+            "lds r24, ptoFastReload+2*" #id "\n\t"                                  \
+            "lds r25, ptoFastReload+2*" #id "+1\n\t"                                \
+            "sbiw r24, 1\n\t"                                                       \
+            "brcs 4f\n\t"                             /* Nothing left: slow path. */ \
+            "sts ptoFastReload+2*" #id "+1, r25\n\t"                                \
+            "sts ptoFastReload+2*" #id ", r24\n\t"                                  \
+            "ldi r24, 0xff\n\t"                       /* This toggle is one of 65536. */ \
+            "sts ptoFastCount+2*" #id ", r24\n\t"                                   \
+            "sts ptoFastCount+2*" #id "+1, r24\n\t"                                 \
+            "rjmp 2b\n\t"                                                           \
+            "4:\n\t"                                                                \
+            "push r0\n\t" "push r1\n\t" PTO_PUSH_RAMPZ "clr r1\n\t"                 \
+            "push r18\n\t" "push r19\n\t" "push r20\n\t" "push r21\n\t"             \
+            "push r22\n\t" "push r23\n\t" "push r26\n\t" "push r27\n\t"             \
+            "push r30\n\t" "push r31\n\t"                                           \
+            "call ptoCompare" #id "\n\t"                                            \
+            "pop r31\n\t" "pop r30\n\t" "pop r27\n\t" "pop r26\n\t"                 \
+            "pop r23\n\t" "pop r22\n\t" "pop r21\n\t" "pop r20\n\t"                 \
+            "pop r19\n\t" "pop r18\n\t"                                             \
+            PTO_POP_RAMPZ "pop r1\n\t" "pop r0\n\t"                                 \
+            "rjmp 2b\n\t");                                                         \
+    }
+#else
+// The same logic in C, for builds that define PTO_PORTABLE_ISR or enable statistics.
+#if PTO_ENABLE_STATISTICS
+#define PTO_STATS_ENTER(id)                                                         \
+        pulseTrainOutput* owner = pulseTrainOutput::_instances[id];                 \
+        if (owner != nullptr) owner->recordInterruptEntry();
+#define PTO_STATS_EXIT(id)                                                          \
+        if (owner != nullptr) owner->recordInterruptExit();
+#else
+#define PTO_STATS_ENTER(id)
+#define PTO_STATS_EXIT(id)
+#endif
+#define PTO_COMPARE_VECTOR(vector, id, tccrA, tccrAddress, ocr, storeOcr)           \
+    extern "C" void ptoCompare##id(void) {                                          \
+        if (pulseTrainOutput::_instances[id] != nullptr) {                          \
+            pulseTrainOutput::_instances[id]->handleInterrupt();                    \
+        }                                                                           \
+    }                                                                               \
+    ISR(vector, __attribute__((weak))) {                                            \
+        PTO_STATS_ENTER(id)                                                         \
+        uint16_t count = ptoFastCount[id];                                          \
+        uint16_t reload = ptoFastReload[id];                                        \
+        if (count != 0) {                                                           \
+            ptoFastCount[id] = --count;                                             \
+            if (count == 0 && reload == 0 && ptoFinish[id]) {                       \
+                tccrA = (tccrA & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A1);       \
+            }                                                                       \
+        } else if (ptoPlayNext[id] != ptoPlayEnd[id]) {                             \
+            const uint16_t* next = ptoPlayNext[id];                                 \
+            ocr = pgm_read_word(next) - 1;                                          \
+            ptoPlayNext[id] = ++next;                                               \
+            if (next == ptoPlayEnd[id] && ptoFinish[id]) {                          \
+                tccrA = (tccrA & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A1);       \
+            }                                                                       \
+        } else if (reload != 0) {                                                   \
+            ptoFastReload[id] = reload - 1;                                         \
+            ptoFastCount[id] = 0xFFFF;                                              \
+        } else {                                                                    \
+            ptoCompare##id();                                                       \
+        }                                                                           \
+        PTO_STATS_EXIT(id)                                                          \
+    }
+#endif
+
+// Weak, so PTO_TIMER_ISR() in a sketch can replace one with a pulseTrainTimer's inlined handler.
+// The ids are the timerIds values, which the assembler needs as plain numbers.
+PTO_COMPARE_VECTOR(TIMER1_COMPA_vect, 0, TCCR1A, "0x80", OCR1A, PTO_STORE_OCR16("0x88"))
+PTO_COMPARE_VECTOR(TIMER2_COMPA_vect, 1, TCCR2A, "0xb0", OCR2A, PTO_STORE_OCR8("0xb3"))
+#if defined(__AVR_ATmega2560__)
+PTO_COMPARE_VECTOR(TIMER3_COMPA_vect, 2, TCCR3A, "0x90", OCR3A, PTO_STORE_OCR16("0x98"))
+PTO_COMPARE_VECTOR(TIMER4_COMPA_vect, 3, TCCR4A, "0xa0", OCR4A, PTO_STORE_OCR16("0xa8"))
+PTO_COMPARE_VECTOR(TIMER5_COMPA_vect, 4, TCCR5A, "0x120", OCR5A, PTO_STORE_OCR16("0x128"))
+#endif
+static_assert(TID_TIMER1 == 0 && TID_TIMER2 == 1 && TID_TIMER5 == 4, "The compare vector ids must match timerIds.");
+
+// The overflow vectors of the 16-bit timers. Only WIDTH trains enable them. Weak, like the compare vectors.
+#define PTO_OVERFLOW_VECTOR(vector, id)                                             \
+    ISR(vector, __attribute__((weak))) {                                            \
+        if (pulseTrainOutput::_instances[id] != nullptr) {                          \
+            pulseTrainOutput::_instances[id]->handleOverflowInterrupt();            \
+        }                                                                           \
+    }
+PTO_OVERFLOW_VECTOR(TIMER1_OVF_vect, 0)
+#if defined(__AVR_ATmega2560__)
+PTO_OVERFLOW_VECTOR(TIMER3_OVF_vect, 2)
+PTO_OVERFLOW_VECTOR(TIMER4_OVF_vect, 3)
+PTO_OVERFLOW_VECTOR(TIMER5_OVF_vect, 4)
+#endif
+
+// --- Hardware Pulse Counter ---
+// A 16-bit timer clocked from its external Tn input counts the rising edges of a wired-back output.
+// Its compare B interrupt is free, because that timer can't drive its own output while counting.
 #if defined(__AVR_ATmega2560__)
-ISR(TIMER3_COMPA_vect) { if (pulseTrainOutput::_instances[TID_TIMER3] != nullptr) { pulseTrainOutput::_instances[TID_TIMER3]->handleInterrupt(); } }
-ISR(TIMER4_COMPA_vect) { if (pulseTrainOutput::_instances[TID_TIMER4] != nullptr) { pulseTrainOutput::_instances[TID_TIMER4]->handleInterrupt(); } }
-ISR(TIMER5_COMPA_vect) { if (pulseTrainOutput::_instances[TID_TIMER5] != nullptr) { pulseTrainOutput::_instances[TID_TIMER5]->handleInterrupt(); } }
+#define PTO_COUNTER_PIN     47          // T5 (PL2).
+#define PTO_COUNTER_TIMER   TID_TIMER5
+#define PTO_COUNTER_TCCRA   TCCR5A
+#define PTO_COUNTER_TCCRB   TCCR5B
+#define PTO_COUNTER_TCNT    TCNT5
+#define PTO_COUNTER_OCR     OCR5B
+#define PTO_COUNTER_TIMSK   TIMSK5
+#define PTO_COUNTER_TIFR    TIFR5
+#define PTO_COUNTER_OCIE    OCIE5B
+#define PTO_COUNTER_OCF     OCF5B
+#define PTO_COUNTER_TOV     TOV5
+#define PTO_COUNTER_VECTOR  TIMER5_COMPB_vect
+#else
+#define PTO_COUNTER_PIN     5           // T1 (PD5).
+#define PTO_COUNTER_TIMER   TID_TIMER1
+#define PTO_COUNTER_TCCRA   TCCR1A
+#define PTO_COUNTER_TCCRB   TCCR1B
+#define PTO_COUNTER_TCNT    TCNT1
+#define PTO_COUNTER_OCR     OCR1B
+#define PTO_COUNTER_TIMSK   TIMSK1
+#define PTO_COUNTER_TIFR    TIFR1
+#define PTO_COUNTER_OCIE    OCIE1B
+#define PTO_COUNTER_OCF     OCF1B
+#define PTO_COUNTER_TOV     TOV1
+#define PTO_COUNTER_VECTOR  TIMER1_COMPB_vect
 #endif
 
+// Weak, like the compare and overflow vectors, so a sketch that doesn't use the counter can take it.
+ISR(PTO_COUNTER_VECTOR, __attribute__((weak))) {
+    if (pulseTrainOutput::_counterOwner != nullptr) {
+        pulseTrainOutput::_counterOwner->handleCounterInterrupt();
+    }
+}
+
+// --- AVR Register Access Layer ---
+// The 8-bit timer's OCR and TCNT are bound through 16-bit pointers so the members stay generic.
+// A 16-bit access there would also hit the neighbouring register (e.g., OCR2B), so narrow it.
+inline void pulseTrainOutput::_writeOcr(uint16_t value) {
+    if (_is16bit) {
+        *_ocr = value;
+    } else {
+        *(volatile uint8_t*)_ocr = (uint8_t)value;
+    }
+}
+
+inline uint16_t pulseTrainOutput::_readOcr() const {
+    return _is16bit ? *_ocr : *(volatile uint8_t*)_ocr;
+}
+
+inline uint16_t pulseTrainOutput::_readCounter() const {
+    PTO_MODEL_READ(_tcnt);
+    return _is16bit ? *_tcnt : *(volatile uint8_t*)_tcnt;
+}
+
+inline void pulseTrainOutput::_writeCounter(uint16_t value) {
+    if (_is16bit) {
+        *_tcnt = value;
+    } else {
+        *(volatile uint8_t*)_tcnt = (uint8_t)value;
+    }
+    PTO_MODEL_WRITE(_tcnt);
+}
+
+// CSn2:0 occupy bits 2:0 of TCCRnB on every AVR timer, 8-bit or 16-bit.
+inline void pulseTrainOutput::_setClock(uint8_t prescalerBits) {
+    *_tccrB = (*_tccrB & ~(_BV(CS12) | _BV(CS11) | _BV(CS10))) | prescalerBits;
+}
+
 #endif // End of platform-specific ISR/callback section
 
 
@@ -131,6 +387,48 @@ pulseTrainOutput::pulseTrainOutput(uint8_t pin) {
     _timerId = TID_INVALID; 
     _isRunning = false;
     _error = NO_ERROR;
+    _queueHead = 0;
+    _queueTail = 0;
+    _counterWraps = 0;
+    _dithering = false;
+    _requestedFrequency = 0;
+    _playTable = nullptr;
+    _playLength = 0;
+    _playRepeats = 0;
+    _playDone = false;
+    _targetSeq = 0;
+    _targetSeen = 0;
+    _burstGapLeft = 0;
+    _position = 0;
+    _direction = 1;
+    _directionPin = 0xFF;
+    _directionSetupUs = 0;
+    _completed = false;
+    _onComplete = nullptr;
+    _phaseCount = 0;
+    _phaseRunning = false;
+    _pausePending = false;
+    _paused = false;
+#if PTO_ENABLE_STATISTICS
+    resetStatistics();
+#endif
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    _axisCount = 0;
+    _axisPortCount = 0;
+    _axisHigh = false;
+    _scheduler = nullptr;
+    _updatePending = false;
+    _hardwareCounting = false;
+    _postscale = 1;
+    _postscaleLeft = 1;
+    _pausedClock = 0;
+    _icr = nullptr;
+    _widthTopPending = false;
+#else
+    _resumeSkip = false;
+    _dtcOpen = false;
+    _streamArmed = false;
+#endif
 
 #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
     auto pin_cgf = getPinCfgs(_pin, PIN_CFG_REQ_PWM);
@@ -151,20 +449,21 @@ pulseTrainOutput::pulseTrainOutput(uint8_t pin) {
 #else
     #if defined(__AVR_ATmega2560__)
         switch (_pin) {
-            case 11: _timerId = TID_TIMER1; _is16bit = true; _tccrA = &TCCR1A; _tccrB = &TCCR1B; _timsk = &TIMSK1; _ocr = &OCR1A; _ocieBit = OCIE1A; _outputPort = &PORTB; _pinBitMask = _BV(PB5); _comStopMask = _BV(COM1A1) | _BV(COM1A0); break;
-            case 10: _timerId = TID_TIMER2; _is16bit = false; _tccrA = &TCCR2A; _tccrB = &TCCR2B; _timsk = &TIMSK2; _ocr = (volatile uint16_t*)&OCR2A; _ocieBit = OCIE2A; _outputPort = &PORTB; _pinBitMask = _BV(PB4); _comStopMask = _BV(COM2A1) | _BV(COM2A0); break;
-            case 5: _timerId=TID_TIMER3; _is16bit=true; _tccrA=&TCCR3A; _tccrB=&TCCR3B; _timsk=&TIMSK3; _ocr=&OCR3A; _ocieBit=OCIE3A; _outputPort=&PORTE; _pinBitMask=_BV(PE3); _comStopMask=_BV(COM3A1)|_BV(COM3A0); break;
-            case 6: _timerId=TID_TIMER4; _is16bit=true; _tccrA=&TCCR4A; _tccrB=&TCCR4B; _timsk=&TIMSK4; _ocr=&OCR4A; _ocieBit=OCIE4A; _outputPort=&PORTH; _pinBitMask=_BV(PH3); _comStopMask=_BV(COM4A1)|_BV(COM4A0); break;
-            case 46: _timerId=TID_TIMER5; _is16bit=true; _tccrA=&TCCR5A; _tccrB=&TCCR5B; _timsk=&TIMSK5; _ocr=&OCR5A; _ocieBit=OCIE5A; _outputPort=&PORTL; _pinBitMask=_BV(PL3); _comStopMask=_BV(COM5A1)|_BV(COM5A0); break;
+            case 11: _timerId = TID_TIMER1; _is16bit = true; _tccrA = &TCCR1A; _tccrB = &TCCR1B; _timsk = &TIMSK1; _tcnt = &TCNT1; _tifr = &TIFR1; _ocr = &OCR1A; _ocieBit = OCIE1A; _outputPort = &PORTB; _pinBitMask = _BV(PB5); _comStopMask = _BV(COM1A1) | _BV(COM1A0); _tccrC = &TCCR1C; _icr = &ICR1; break;
+            case 10: _timerId = TID_TIMER2; _is16bit = false; _tccrA = &TCCR2A; _tccrB = &TCCR2B; _timsk = &TIMSK2; _tcnt = (volatile uint16_t*)&TCNT2; _tifr = &TIFR2; _ocr = (volatile uint16_t*)&OCR2A; _ocieBit = OCIE2A; _outputPort = &PORTB; _pinBitMask = _BV(PB4); _comStopMask = _BV(COM2A1) | _BV(COM2A0); _tccrC = &TCCR2B; _icr = nullptr; break;
+            case 5: _timerId=TID_TIMER3; _is16bit=true; _tccrA=&TCCR3A; _tccrB=&TCCR3B; _timsk=&TIMSK3; _tcnt=&TCNT3; _tifr=&TIFR3; _ocr=&OCR3A; _ocieBit=OCIE3A; _outputPort=&PORTE; _pinBitMask=_BV(PE3); _comStopMask=_BV(COM3A1)|_BV(COM3A0); _tccrC=&TCCR3C; _icr=&ICR3; break;
+            case 6: _timerId=TID_TIMER4; _is16bit=true; _tccrA=&TCCR4A; _tccrB=&TCCR4B; _timsk=&TIMSK4; _tcnt=&TCNT4; _tifr=&TIFR4; _ocr=&OCR4A; _ocieBit=OCIE4A; _outputPort=&PORTH; _pinBitMask=_BV(PH3); _comStopMask=_BV(COM4A1)|_BV(COM4A0); _tccrC=&TCCR4C; _icr=&ICR4; break;
+            case 46: _timerId=TID_TIMER5; _is16bit=true; _tccrA=&TCCR5A; _tccrB=&TCCR5B; _timsk=&TIMSK5; _tcnt=&TCNT5; _tifr=&TIFR5; _ocr=&OCR5A; _ocieBit=OCIE5A; _outputPort=&PORTL; _pinBitMask=_BV(PL3); _comStopMask=_BV(COM5A1)|_BV(COM5A0); _tccrC=&TCCR5C; _icr=&ICR5; break;
         }
     #else // Arduino Uno, Nano, etc.
         switch (_pin) {
-            case 9: _timerId=TID_TIMER1; _is16bit=true; _tccrA=&TCCR1A; _tccrB=&TCCR1B; _timsk=&TIMSK1; _ocr=&OCR1A; _ocieBit=OCIE1A; _outputPort=&PORTB; _pinBitMask=_BV(PB1); _comStopMask=_BV(COM1A1)|_BV(COM1A0); break;
-            case 11: _timerId=TID_TIMER2; _is16bit=false; _tccrA=&TCCR2A; _tccrB=&TCCR2B; _timsk=&TIMSK2; _ocr=(volatile uint16_t*)&OCR2A; _ocieBit=OCIE2A; _outputPort=&PORTB; _pinBitMask=_BV(PB3); _comStopMask=_BV(COM2A1)|_BV(COM2A0); break;
+            case 9: _timerId=TID_TIMER1; _is16bit=true; _tccrA=&TCCR1A; _tccrB=&TCCR1B; _timsk=&TIMSK1; _tcnt=&TCNT1; _tifr=&TIFR1; _ocr=&OCR1A; _ocieBit=OCIE1A; _outputPort=&PORTB; _pinBitMask=_BV(PB1); _comStopMask=_BV(COM1A1)|_BV(COM1A0); _tccrC=&TCCR1C; _icr=&ICR1; break;
+            case 11: _timerId=TID_TIMER2; _is16bit=false; _tccrA=&TCCR2A; _tccrB=&TCCR2B; _timsk=&TIMSK2; _tcnt=(volatile uint16_t*)&TCNT2; _tifr=&TIFR2; _ocr=(volatile uint16_t*)&OCR2A; _ocieBit=OCIE2A; _outputPort=&PORTB; _pinBitMask=_BV(PB3); _comStopMask=_BV(COM2A1)|_BV(COM2A0); _tccrC=&TCCR2B; _icr=nullptr; break;
         }
     #endif
     if (_timerId != TID_INVALID) {
         _instances[_timerId] = this;
+        _inputPort = portInputRegister(digitalPinToPort(_pin));
         pinMode(_pin, OUTPUT);
     } else {
       _error = INVALID_PIN;
@@ -173,6 +472,20 @@ pulseTrainOutput::pulseTrainOutput(uint8_t pin) {
 }
 
 bool pulseTrainOutput::generate(uint32_t frequency, pulseModes mode, uint32_t pulses) {
+    pulseTiming timing;
+    if (!_prepareGenerate(frequency, mode, pulses, timing)) {
+        return false;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    _timer.start();
+    _isRunning = true;
+#else
+    _launch(timing, pulses);
+#endif
+    return true;
+}
+
+bool pulseTrainOutput::_prepareGenerate(uint32_t frequency, pulseModes mode, uint32_t pulses, pulseTiming& timing, int8_t sourceDiv) {
     if (_isRunning) {
         _error = ACTIVE;
         return false;
@@ -203,6 +516,301 @@ bool pulseTrainOutput::generate(uint32_t frequency, pulseModes mode, uint32_t pu
         _pulseCounter = _pulsesToGenerate;
     }
     
+    (void)timing;
+    _requestedFrequency = frequency;
+    return _openTimer(frequency, mode, sourceDiv);
+
+#else
+    // --- AVR Generate Logic ---
+    (void)sourceDiv;
+    if (_pulseMode == DISCRETE) {
+        _pulsesToGenerate = pulses * 2;
+        _pulseCounter = _pulsesToGenerate;
+    }
+    if (!_calculateTimingParameters(frequency, timing)) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    _requestedFrequency = frequency;
+    return true;
+#endif
+}
+
+// The period in counts of 'clock' that comes closest to 'frequency', or 0 if neither neighbour fits.
+// 'error' gets |clock - frequency * counts|, which is the frequency error scaled by counts.
+static uint32_t nearestCounts(uint32_t clock, uint32_t frequency, uint32_t maxCounts, uint64_t& error) {
+    uint32_t below = clock / frequency;
+    uint32_t best = 0;
+    for (uint64_t counts = below; counts <= (uint64_t)below + 1; counts++) {
+        if (counts < 2 || counts > maxCounts) {
+            continue;
+        }
+        uint64_t produced = (uint64_t)frequency * counts;
+        uint64_t candidateError = produced > clock ? produced - clock : clock - produced;
+        if (best == 0 || candidateError * best < error * counts) {
+            best = counts;
+            error = candidateError;
+        }
+    }
+    return best;
+}
+
+// A time in nanoseconds as the nearest whole number of counts of 'clock'.
+static uint32_t nanosToCounts(uint32_t nanos, uint32_t clock) {
+    return ((uint64_t)nanos * clock + 500000000ULL) / 1000000000ULL;
+}
+
+// Disables interrupts and returns the state to restore. Unlike noInterrupts()/interrupts(), the pair
+// is safe in code a completion callback can reach, where it runs inside the ISR.
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+typedef uint32_t interruptState;
+
+static inline interruptState saveInterrupts() {
+    interruptState state = __get_PRIMASK();
+    __disable_irq();
+    return state;
+}
+
+static inline void restoreInterrupts(interruptState state) {
+    __set_PRIMASK(state);
+}
+#else
+typedef uint8_t interruptState;
+
+static inline interruptState saveInterrupts() {
+    interruptState state = SREG;
+    cli();
+    return state;
+}
+
+static inline void restoreInterrupts(interruptState state) {
+    SREG = state;
+}
+#endif
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+void pulseTrainOutput::_launch(const pulseTiming& timing, uint32_t pulses) {
+    // Trains of one or two pulses are left to the ISR: the counter can't flag a match on its first count.
+    // A dithered train needs the ISR on every edge anyway, so it counts there too.
+    // A postscaled train needs the ISR on every match to move the pin, so it counts there too.
+    bool postscaled = (timing.postscale > 1);
+    bool hardwareCount = (_pulseMode == DISCRETE && _counterOwner == this && pulses > 2 && !_dithering && !postscaled);
+    _hardwareCounting = hardwareCount;
+    _updatePending = false;
+    if (hardwareCount) {
+        _armCounter(pulses);
+    } else if (_pulseMode == DISCRETE && !_dithering && !postscaled) {
+        _delegateCount();                 // The timer is stopped and its interrupt off, so this is safe here.
+    }
+    _startTimer(timing, (_pulseMode == DISCRETE && !hardwareCount) || _dithering || postscaled);
+}
+
+void pulseTrainOutput::_startTimer(const pulseTiming& timing, bool countPulses, bool drivePin) {
+    uint8_t oldSREG = SREG;          // Restored rather than sei(), so a group start can hold interrupts off across several timers.
+    cli();
+
+    *_tccrA = 0;
+    *_tccrB = 0;
+    _writeOcr(timing.top);
+    _writeCounter(0);                // A count left over from a previous train could sit above the new OCR.
+    *_tifr = (1 << _ocieBit);        // OCFnA shares its bit position with OCIEnA. Writing a one clears a stale flag.
+    PTO_MODEL_WRITE(_tifr);
+    switch (_timerId) {
+        case TID_TIMER1: case TID_TIMER3: case TID_TIMER4: case TID_TIMER5:
+            *_tccrA |= _BV(COM1A0); *_tccrB |= _BV(WGM12); break;
+        case TID_TIMER2:
+            *_tccrA |= _BV(COM2A0) | _BV(WGM21); break;
+    }
+    if (!drivePin) {
+        *_tccrA &= ~_comStopMask;
+    } else if (_phaseCount != 0 && (_pulseMode == DISCRETE || _pulseMode == CONTINUOUS)
+               && timing.postscale <= 1 && !_dithering) {
+        _startPhaseOutputs(timing.top);
+    }
+    _setPostscale(timing.postscale, false);
+    if (countPulses) {
+        *_timsk |= (1 << _ocieBit);
+    }
+#if PTO_ENABLE_STATISTICS
+    _statsLastHigh = false;          // Every train starts LOW, so its first match raises the pin.
+#endif
+    _isRunning = true;
+    _setClock(timing.prescalerBits);
+    SREG = oldSREG;
+}
+
+void pulseTrainOutput::_armCounter(uint32_t pulses) {
+    // A match sets the flag on the count after TCNT reaches OCR, so a target of pulses - 1
+    // interrupts on the rising edge of the last pulse. Above 16 bits the counter wraps and
+    // _counterWraps absorbs the extra matches.
+    uint32_t target = pulses - 1;
+    uint16_t wraps = target >> 16;
+    if ((target & 0xFFFF) == 0) {
+        wraps--;                          // Writing TCNT blocks the match on the first count, so OCR = 0 loses one.
+    }
+    uint8_t oldSREG = SREG;
+    cli();
+    PTO_COUNTER_TCCRB = 0;
+    PTO_COUNTER_TCCRA = 0;                // Normal mode, output pins disconnected.
+    PTO_COUNTER_TCNT = 0;
+    PTO_MODEL_WRITE(&PTO_COUNTER_TCNT);
+    PTO_COUNTER_OCR = target & 0xFFFF;
+    _counterWraps = wraps;
+    PTO_COUNTER_TIFR = _BV(PTO_COUNTER_OCF) | _BV(PTO_COUNTER_TOV);    // _pulsesEmitted() reads both.
+    PTO_MODEL_WRITE(&PTO_COUNTER_TIFR);
+    PTO_COUNTER_TIMSK |= _BV(PTO_COUNTER_OCIE);
+    PTO_COUNTER_TCCRB = _BV(CS12) | _BV(CS11) | _BV(CS10);  // External clock on Tn, rising edge.
+    SREG = oldSREG;
+}
+
+// log2 of the prescaler divider for each CS value. The CS values run in order of increasing divider,
+// which the solver relies on. Also used to carry a count across a prescaler change.
+static const uint8_t timer16Shift[8] = {0, 0, 3, 6, 8, 10, 0, 0};
+static const uint8_t timer8Shift[8] = {0, 0, 3, 5, 6, 7, 8, 10};
+
+// Timer counts that may pass between reading TCNT and writing OCR in _applyTiming().
+#define PTO_UPDATE_MARGIN 16
+
+void pulseTrainOutput::_applyTiming(const pulseTiming& timing) {
+    uint8_t oldBits = *_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10));
+    uint16_t top = timing.top;
+    if (timing.prescalerBits == oldBits && (uint32_t)_readCounter() + PTO_UPDATE_MARGIN < top && !_phaseRunning) {
+        _writeOcr(top);                   // The counter can't reach the new top before this lands.
+        return;
+    }
+    // Hold the clock while the count is moved into the new prescaler's units. A count already at or
+    // past the new top is pulled back below it, so the half period ends on the next count or two
+    // instead of after a wrap through 0xFFFF. (Writing TCNT blocks a match on the following count.)
+    _setClock(0);
+    const uint8_t* shifts = _is16bit ? timer16Shift : timer8Shift;
+    uint16_t oldCount = _readCounter();
+    uint32_t count = ((uint32_t)oldCount << shifts[oldBits]) >> shifts[timing.prescalerBits];
+    if (count >= top) {
+        count = top ? top - 1 : 0;
+    }
+    _writeOcr(top);
+    _writeCounter(count);
+    if (_phaseRunning) {
+        _retimePhaseOutputs(oldCount, count + 1, top);
+    }
+    if (!_is16bit && timing.prescalerBits != oldBits) {
+        GTCCR = _BV(PSRASY);              // Timer2 has a prescaler of its own, so start its first tick from now.
+    }
+    _setClock(timing.prescalerBits);
+}
+
+void pulseTrainOutput::_setPostscale(uint16_t postscale, bool high) {
+    postscale = postscale > 1 ? postscale : 1;
+    if (postscale > 1 && _phaseRunning) {
+        _stopPhaseOutputs();              // Only channel A follows the postscaler.
+    }
+    _postscale = postscale;
+    _postscaleLeft = postscale;
+    if (!(*_tccrA & _comStopMask)) {
+        return;                           // COORDINATED: the interrupt drives the axes, not the pin.
+    }
+    uint8_t com = _BV(COM1A0);            // Toggle.
+    if (postscale > 1) {
+        com = high ? (_BV(COM1A1) | _BV(COM1A0)) : _BV(COM1A1);    // Set or Clear, which leave the pin as it is.
+    }
+    *_tccrA = (*_tccrA & ~(_BV(COM1A1) | _BV(COM1A0))) | com;
+}
+
+uint16_t pulseTrainOutput::_phaseCompare(uint8_t index, uint16_t top, bool& high) const {
+    // Channel A toggles as the counter passes top, and a phase output as it passes its compare, a
+    // delay of compare + 1 counts into the next half period. Started LOW the output lags by half a
+    // period plus that delay; started HIGH, by the delay alone.
+    uint16_t phase = _phaseDegrees[index];
+    high = (phase != 0 && phase <= 180);
+    if (phase > 180) {
+        phase -= 180;
+    } else if (phase == 0) {
+        phase = 180;
+    }
+    uint32_t delay = ((uint32_t)phase * ((uint32_t)top + 1) + 90) / 180;
+    return delay ? delay - 1 : 0;
+}
+
+void pulseTrainOutput::_startPhaseOutputs(uint16_t top) {
+    for (uint8_t i = 0; i < _phaseCount; i++) {
+        bool high;
+        uint16_t compare = _phaseCompare(i, top, high);
+        if (_is16bit) {
+            *(volatile uint16_t*)_phaseOcr[i] = compare;
+        } else {
+            *_phaseOcr[i] = compare;
+        }
+        // Force the latch to the starting level with "Set" or "Clear", then leave it toggling.
+        uint8_t com = _phaseCom[i];
+        *_tccrA = (*_tccrA & ~(com | com << 1)) | com << 1 | (high ? com : 0);
+        *_tccrC |= _phaseFoc[i];
+        *_tccrA = (*_tccrA & ~(com << 1)) | com;
+    }
+    _phaseRunning = true;
+}
+
+void pulseTrainOutput::_retimePhaseOutputs(uint16_t oldCount, uint16_t firstCount, uint16_t top) {
+    for (uint8_t i = 0; i < _phaseCount; i++) {
+        uint16_t oldCompare;
+        bool high;
+        uint16_t compare = _phaseCompare(i, top, high);
+        if (_is16bit) {
+            oldCompare = *(volatile uint16_t*)_phaseOcr[i];
+            *(volatile uint16_t*)_phaseOcr[i] = compare;
+        } else {
+            oldCompare = *_phaseOcr[i];
+            *_phaseOcr[i] = compare;
+        }
+        // The output toggles once per half period. If it already has and its new compare is still
+        // ahead, or it hasn't and the counter is already past the new compare, toggle it now.
+        if ((oldCount > oldCompare) == (firstCount <= compare)) {
+            *_tccrC |= _phaseFoc[i];
+        }
+    }
+}
+
+void pulseTrainOutput::_stopPhaseOutputs() {
+    for (uint8_t i = 0; i < _phaseCount; i++) {
+        // Park the latch LOW before disconnecting, as stop() does for channel A.
+        uint8_t com = _phaseCom[i];
+        *_tccrA = (*_tccrA & ~(com | com << 1)) | com << 1;
+        *_tccrC |= _phaseFoc[i];
+        *_tccrA &= ~(com | com << 1);
+        *_phasePorts[i] &= ~_phaseMasks[i];
+    }
+    _phaseRunning = false;
+}
+
+void pulseTrainOutput::_delegateCount() {
+    // The last toggle always comes back here, so handleInterrupt() still ends the train or loads the
+    // next segment. The fast path only finishes the train itself if nothing is queued; queue()
+    // withdraws that.
+    if (_pulseCounter > 1) {
+        uint32_t count = _pulseCounter - 1;
+        _pulseCounter = 1;
+        ptoFinish[_timerId] = (_queueHead == _queueTail);
+        ptoFastReload[_timerId] = count >> 16;
+        ptoFastCount[_timerId] = count & 0xFFFF;
+    }
+}
+
+void pulseTrainOutput::_reclaimCount() {
+    _pulseCounter += ((uint32_t)ptoFastReload[_timerId] << 16) + ptoFastCount[_timerId];
+    ptoFastReload[_timerId] = 0;
+    ptoFastCount[_timerId] = 0;
+}
+
+void pulseTrainOutput::_stopCounter() {
+    PTO_COUNTER_TCCRB = 0;
+    PTO_COUNTER_TIMSK &= ~_BV(PTO_COUNTER_OCIE);
+}
+#else
+// GTSTR, GTSTP, GTCNT and GTIOR sit at the same offsets in every GPT channel's register block.
+static R_GPT0_Type* gptRegisters(uint8_t channel) {
+    return (R_GPT0_Type*)((uintptr_t)R_GPT0 + channel * ((uintptr_t)R_GPT1 - (uintptr_t)R_GPT0));
+}
+
+bool pulseTrainOutput::_openTimer(uint32_t frequency, pulseModes mode, int8_t sourceDiv) {
     // Select the correct hardcoded callback based on the timer channel for this pin.
     void (*selected_callback)(timer_callback_args_t*) = nullptr;
     if (_timer_channel < (sizeof(r4_callbacks) / sizeof(r4_callbacks[0]))) {
@@ -211,64 +819,89 @@ bool pulseTrainOutput::generate(uint32_t frequency, pulseModes mode, uint32_t pu
 
     // We must use the .begin() method to register the callback.
     _timer.begin(TIMER_MODE_PWM, _is_agt, _timer_channel, frequency, 50, selected_callback);
-    
-    if (mode == DISCRETE) {
+
+    if (!_is_agt) {
+        // begin() takes the smallest divider that fits. Try them all and keep the one whose period lands
+        // closest to the request; a tie keeps the smaller divider and its finer updateFrequency() steps.
+        uint32_t maxCounts = (_timer_channel < 2) ? 0xFFFFFFFFUL : 0x10000UL;
+        uint32_t sourceClock = R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_PCLKD);
+        uint32_t bestCounts = 0;
+        uint64_t bestError = 0;
+        uint8_t bestDiv = 0;
+        uint8_t firstDiv = sourceDiv < 0 ? 0 : sourceDiv;
+        uint8_t lastDiv = sourceDiv < 0 ? 10 : sourceDiv;
+        for (uint8_t div = firstDiv; div <= lastDiv; div += 2) {  // GPT divides PCLKD by 1, 4, 16, 64, 256 or 1024.
+            uint64_t error;
+            uint32_t counts = nearestCounts(sourceClock >> div, frequency, maxCounts, error);
+            if (counts && (bestCounts == 0 || error * bestCounts < bestError * counts)) {
+                bestCounts = counts;
+                bestError = error;
+                bestDiv = div;
+            }
+        }
+        if (bestCounts) {
+            timer_cfg_t* cfg = _timer.get_cfg();
+            cfg->source_div = (timer_source_div_t)bestDiv;
+            cfg->period_counts = bestCounts;
+            cfg->duty_cycle_counts = bestCounts / 2;
+        }
+    }
+
+    if ((mode != CONTINUOUS && !(mode == WIDTH && _pulsesToGenerate == 0)) || _dithering) {
         // ** FIX #2: Call setup_overflow_irq() with NO arguments. **
         // This enables the interrupt for the callback that was already registered in .begin().
         _timer.setup_overflow_irq();
     }
     _timer.add_pwm_extended_cfg();
     _timer.enable_pwm_channel(_pwm_channel);
+    TimerPWMChannel_t phaseChannel = (_pwm_channel == CHANNEL_A) ? CHANNEL_B : CHANNEL_A;
+    _phaseRunning = (_phaseCount != 0 && (mode == DISCRETE || mode == CONTINUOUS) && !_dithering);
+    if (_phaseRunning) {
+        _timer.enable_pwm_channel(phaseChannel);
+    }
      // --- ADD THIS CHECK ---
     if (!_timer.open()) {
         // If open() returns false, the hardware setup failed.
         _error = TIMER_OPEN_FAILED; // Let's use 7 as a custom error for "TIMER_OPEN_FAILED"
         _isRunning = false;
+        _phaseRunning = false;
         return false;
     }
     // --- END OF CHECK ---
-
-    _timer.start();
-    _isRunning = true;
+    if (_phaseRunning) {
+        _timer.set_duty_cycle(_timer.get_cfg()->duty_cycle_counts, phaseChannel);
+        if (_phaseDegrees[0] == 180) {
+            // The complement goes HIGH at the compare match and LOW at the end of the period.
+            uint8_t shift = (phaseChannel == CHANNEL_A) ? 0 : 16;      // GTIOA or GTIOB.
+            R_GPT0_Type* gpt = gptRegisters(_timer_channel);
+            gpt->GTIOR = (gpt->GTIOR & ~(0x1FUL << shift)) | (0x06UL << shift);
+        }
+    }
     return true;
+}
 
-#else
-    // --- AVR Generate Logic ---
-    if (_pulseMode == DISCRETE) {
-        _pulsesToGenerate = pulses * 2;
-        _pulseCounter = _pulsesToGenerate;
-    }
-    uint32_t ocrValue;
-    uint8_t prescalerBits;
-    if (!_calculateTimingParameters(frequency, ocrValue, prescalerBits)) {
+bool pulseTrainOutput::_setDuty(uint32_t counts) {
+    if (_phaseRunning && !_timer.set_duty_cycle(counts, (_pwm_channel == CHANNEL_A) ? CHANNEL_B : CHANNEL_A)) {
         return false;
     }
-    cli();
-
-    *_tccrA = 0;
-    *_tccrB = 0;
-    *_ocr = ocrValue;
-    switch (_timerId) {
-        case TID_TIMER1: case TID_TIMER3: case TID_TIMER4: case TID_TIMER5:
-            *_tccrA |= _BV(COM1A0); *_tccrB |= _BV(WGM12); break;
-        case TID_TIMER2:
-            *_tccrA |= _BV(COM2A0) | _BV(WGM21); break;
-    }
-    if (mode == DISCRETE) {
-        *_timsk |= (1 << _ocieBit);
-    }
-    _isRunning = true;
-    *_tccrB |= prescalerBits;
-    sei();
-    return true;
-#endif
+    return _timer.set_duty_cycle(counts, _pwm_channel);
 }
+#endif
 
 bool pulseTrainOutput::updateFrequency(uint32_t newFrequency) {
-    if (!_isRunning || newFrequency == 0) {
+    if (!_isRunning || newFrequency == 0 || _pulseMode >= PLAYBACK) {
         return false;
     }
+    pulseTiming timing;
 #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (_calculateTimingParameters(newFrequency, timing)) {
+        // The period fits the divider chosen by begin(), so skip FspTimer's floating point path.
+        if (!updateFrequency(timing)) {
+            return false;
+        }
+        _requestedFrequency = newFrequency;
+        return true;
+    }
     bool success = _timer.set_frequency(newFrequency);
     if (success) {
         // IMPORTANT: The FspTimer::set_frequency function does not automatically
@@ -281,122 +914,2921 @@ bool pulseTrainOutput::updateFrequency(uint32_t newFrequency) {
         uint32_t duty_counts = period_counts / 2;
 
         // Set the new duty cycle in raw counts
-        success = _timer.set_duty_cycle(duty_counts, _pwm_channel);
+        success = _setDuty(duty_counts);
     }
+    _dithering = false;
+    _requestedFrequency = success ? newFrequency : 0;
     return success;
 #else
-    uint32_t ocrValue;
-    uint8_t prescalerBits;
-    if (!_calculateTimingParameters(newFrequency, ocrValue, prescalerBits)) {
+    if (!_calculateTimingParameters(newFrequency, timing)) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    if (!updateFrequency(timing)) {
+        _error = FREQUENCY_HIGH;          // A MOVE writes every interval itself, so it can't be postscaled.
+        return false;
+    }
+    _requestedFrequency = newFrequency;
+    return true;
+#endif
+}
+
+bool pulseTrainOutput::updateFrequency(const pulseTiming& timing) {
+    if (!_isRunning || _pulseMode >= PLAYBACK || (_pulseMode == MOVE && timing.postscale > 1)) {
+        return false;
+    }
+    _requestedFrequency = 0;              // Raw settings carry no request; getFrequencyError() reads 0.
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    // Both the period and the duty compare are buffered by the GPT and take effect at the next overflow.
+    _dithering = false;
+    if (!_timer.set_period(timing.top)) {
         return false;
     }
+    return _setDuty(timing.top / 2);
+#else
     cli();
-    uint8_t tccrb_cache = *_tccrB; 
-    *_tccrB &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10));
-    *_ocr = ocrValue;
-    *_tccrB = (tccrb_cache & ~(_BV(CS12) | _BV(CS11) | _BV(CS10))) | prescalerBits;
+    _reclaimCount();                      // The commit has to see every edge until it lands.
+    _stagedTiming = timing;
+    _updatePending = true;
+    if (!(*_timsk & (1 << _ocieBit))) {
+        // CONTINUOUS trains run without the interrupt, so enable it just for the commit. The flag
+        // left by an earlier match is discarded so the commit waits for a real boundary.
+        *_tifr = (1 << _ocieBit);
+        PTO_MODEL_WRITE(_tifr);
+        *_timsk |= (1 << _ocieBit);
+    }
     sei();
     return true;
 #endif
 }
 
+bool pulseTrainOutput::calculateTiming(uint32_t frequency, pulseTiming& timing) {
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    if (!_calculateTimingParameters(frequency, timing)) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    return true;
+}
+
 #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
 void pulseTrainOutput::stop() {
     _timer.stop();
+    _foldPosition();                      // A stream is counted from the DTC's transfer info, so before it closes.
+    if (_dtcOpen) {
+        R_DTC_Close(&_dtcCtrl);           // Before end() releases the overflow IRQ it's attached to.
+        _dtcOpen = false;
+    }
+    _streamArmed = false;
     _timer.end();
+    if (_pausePending || _paused) {
+        _holdCycleEnd(false);
+    }
+    _dithering = false;
+    _phaseRunning = false;
+    _pausePending = false;
+    _paused = false;
+    _resumeSkip = false;
+    _queueTail = _queueHead;              // Anything still queued belonged to the train that was stopped.
     _isRunning = false;
 }
 #else
 void pulseTrainOutput::stop() {
+    // Park the output compare latch LOW before disconnecting the pin. Otherwise a train stopped
+    // during a HIGH half would leave it set, and the next train's first toggle would be a fall.
+    // FOCnA only works outside the PWM modes, so a WIDTH train drops to CTC (ICRn as TOP) first.
+    uint8_t pwmBits = (_pulseMode == WIDTH) ? _BV(WGM11) : 0;
+    *_tccrA = (*_tccrA & ~(_comStopMask | pwmBits)) | (_comStopMask & _BV(COM1A1));
+    *_tccrC |= _BV(FOC1A);
     *_tccrA &= ~_comStopMask;
     *_outputPort &= ~_pinBitMask;
-    switch (_timerId) {
-        case TID_TIMER1: case TID_TIMER3: case TID_TIMER4: case TID_TIMER5:
-            *_tccrB &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10)); break;
-        case TID_TIMER2:
-            *_tccrB &= ~(_BV(CS22) | _BV(CS21) | _BV(CS20)); break;
+    if (_phaseRunning) {
+        _stopPhaseOutputs();
     }
+    _setClock(0);
     *_timsk &= ~(1 << _ocieBit);
+    if (_pulseMode == WIDTH) {
+        *_tccrB &= ~_BV(WGM13);           // Back to plain CTC.
+        *_timsk &= ~_BV(TOIE1);
+    }
+    _foldPosition();                      // Reads the fast path's counts, so before they're cleared.
+    ptoFastCount[_timerId] = 0;
+    ptoFastReload[_timerId] = 0;
+    ptoPlayNext[_timerId] = nullptr;
+    ptoPlayEnd[_timerId] = nullptr;
+    if (_counterOwner == this) {
+        _stopCounter();
+    }
+    _hardwareCounting = false;
+    _updatePending = false;
+    _widthTopPending = false;
+    _dithering = false;
+    _pausePending = false;
+    _paused = false;
+    if (_pulseMode == COORDINATED) {
+        for (uint8_t i = 0; i < _axisPortCount; i++) {
+            *_axisPorts[i] &= ~_axisRaised[i];
+            _axisRaised[i] = 0;
+        }
+    }
+    _queueTail = _queueHead;              // Anything still queued belonged to the train that was stopped.
     _isRunning = false;
 }
 #endif
 
 #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
-void pulseTrainOutput::handleInterrupt() {
-        if (_pulseMode == DISCRETE) {
-            if (_pulseCounter == 0) {
-                stop();
-            }
-            if (_pulseCounter > 0) {
-                _pulseCounter--;
-                if (_pulseCounter == 0) {
-                    // Instead of stopping, we command the PWM to be silent for the next full cycle.
-                    // This holds the output pin low, creating our "final off cycle".
-                    _timer.set_duty_cycle(0, _pwm_channel);
-                }
-            }
-        }
-    }
-#else
-void pulseTrainOutput::handleInterrupt() {
-        if (_pulseMode == DISCRETE) {
-            _pulseCounter--;
-            if (_pulseCounter == 1) {
-                // This is the interrupt for the RISING edge of the very last pulse.
-                // We reconfigure the timer's NEXT action from "Toggle" to "Clear" (Force LOW).
-                // This must be done in a single, atomic operation to prevent a glitch.
-                
-                uint8_t currentTCCRA = *_tccrA;
-                // First, clear the existing COM bits (both 1 and 0)
-                currentTCCRA &= ~(_BV(COM1A1) | _BV(COM1A0));
-                // Then, set the new COM bits for "Clear on Compare Match" (COMxA1=1, COMxA0=0)
-                currentTCCRA |= _BV(COM1A1);
-                // Write the new configuration back to the register in one operation.
-                *_tccrA = currentTCCRA;
-
-            }//
-             else if (_pulseCounter == 0) {
-                stop();
-            }
+void pulseTrainOutput::_holdCycleEnd(bool hold) {
+    // GTIOA sits in bits 3:0 of GTIOR and GTIOB in bits 19:16. 0x9 drives the pin LOW at the compare
+    // and HIGH at the end of the period; 0x1 leaves it as it is at the end. An inverted phase
+    // output (0x6) already falls there, so it's left alone.
+    R_GPT0_Type* gpt = gptRegisters(_timer_channel);
+    uint32_t gtior = gpt->GTIOR;
+    for (uint8_t shift = 0; shift <= 16; shift += 16) {
+        uint32_t mode = (gtior >> shift) & 0x0F;
+        if (mode == 0x09 || mode == 0x01) {
+            gtior = (gtior & ~(0x0FUL << shift)) | ((hold ? 0x01UL : 0x09UL) << shift);
         }
     }
-#endif
-
-
-bool pulseTrainOutput::isRunning() const{
-    return _isRunning;
+    gpt->GTIOR = gtior;
 }
 
-uint8_t pulseTrainOutput::getError() const{
-    return _error;
+void pulseTrainOutput::_holdPaused() {
+    gptRegisters(_timer_channel)->GTSTP = 1UL << _timer_channel;
+    _pausePending = false;
+    _paused = true;
 }
 
+bool pulseTrainOutput::pause() {
+    if (!_isRunning || _pulseMode != DISCRETE || _is_agt) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    noInterrupts();
+    if (!_paused) {
+        // Each period starts HIGH. Keep the pin LOW at the end of this one, and let the callback
+        // stop the counter once it has.
+        _holdCycleEnd(true);
+        _pausePending = true;
+    }
+    interrupts();
+    return true;
+}
+
+bool pulseTrainOutput::resume() {
+    if (!_isRunning || _pulseMode != DISCRETE || _is_agt) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    noInterrupts();
+    _holdCycleEnd(false);
+    _pausePending = false;
+    if (_paused) {
+        // The held period never raised the pin, so run it again from the start. With the counter at
+        // the end of the period, the next count is an overflow that does.
+        R_GPT0_Type* gpt = gptRegisters(_timer_channel);
+        gpt->GTCNT = gpt->GTPR;
+        _resumeSkip = true;
+        _paused = false;
+        gpt->GTSTR = 1UL << _timer_channel;
+    }
+    interrupts();
+    return true;
+}
+
+bool pulseTrainOutput::abort(pulseTrainReport& report) {
+    noInterrupts();
+    bool running = _isRunning;
+    bool high = running && digitalRead(_pin) == HIGH;
+    bool started = false;                 // The period running now raised the pin at its start.
+    bool ended = false;                   // A period ended that the callback hasn't counted yet.
+    if (running && !_is_agt) {
+        R_GPT0_Type* gpt = gptRegisters(_timer_channel);
+        gpt->GTSTP = 1UL << _timer_channel;
+        high = digitalRead(_pin) == HIGH;
+        // Force 0% duty on both pins (OADTY/OBDTY = 10b). With OADTYF/OBDTYF set it applies at once.
+        gpt->GTUDDTYC = (gpt->GTUDDTYC & ~((0x3UL << 16) | (0x3UL << 24)))
+                      | (0x2UL << 16) | (1UL << 18) | (0x2UL << 24) | (1UL << 26);
+        ended = NVIC_GetPendingIRQ(_timer.get_cfg()->cycle_end_irq);
+        // A LOW pin before the compare means the period was held or silenced, not that it has fallen.
+        started = high || gpt->GTCNT >= gpt->GTCCR[(_pwm_channel == CHANNEL_A) ? 0 : 1];
+    }
+    report.emitted = 0;
+    report.remaining = 0;
+    report.truncated = high;
+    uint32_t extra = 0;
+    if (running && (_pulseMode == DISCRETE || _pulseMode == MOVE || _pulseMode == WIDTH || _pulseMode == STREAM)) {
+        uint32_t left = _pulseCounter;
+        if (_streamArmed) {
+            left = 2 + _dtcInfo[0].length;   // The DTC has already taken every overflow, as _pulsesEmitted() reads.
+        } else if (ended && left > 0) {
+            left--;
+        }
+        uint32_t emitted = _pulsesToGenerate - left + (left > 0 && !_paused && started);
+        extra = emitted - _pulsesEmitted();   // stop() only folds what the callback has counted.
+        report.emitted = emitted;
+        report.remaining = _pulsesToGenerate - emitted;
+    }
+    if (running) {
+        stop();
+        _position += (_direction > 0) ? (int32_t)extra : -(int32_t)extra;
+    }
+    interrupts();
+    return running;
+}
+#else
+void pulseTrainOutput::_holdPaused() {
+    _pausedClock = *_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10));
+    _setClock(0);
+    _pausePending = false;
+    _paused = true;
+}
+
+bool pulseTrainOutput::pause() {
+    if (!_isRunning || _pulseMode != DISCRETE) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    uint8_t oldSREG = SREG;
+    cli();
+    if (!_paused) {
+        // Until the hold lands every edge has to reach handleInterrupt(), so take the fast path's count back.
+        _reclaimCount();
+        _pausePending = true;
+        bool enabled = *_timsk & (1 << _ocieBit);
+        if (!(*_inputPort & _pinBitMask) && !(enabled && (*_tifr & (1 << _ocieBit)))
+            && (uint32_t)_readCounter() + PTO_UPDATE_MARGIN < _readOcr()) {
+            _holdPaused();                // In a LOW half with no edge due, so hold here.
+        } else if (!enabled) {
+            // A hardware counted train runs without the interrupt. Enable it for the falling edge,
+            // discarding the flag left by an earlier match.
+            *_tifr = (1 << _ocieBit);
+            PTO_MODEL_WRITE(_tifr);
+            *_timsk |= (1 << _ocieBit);
+        }
+    }
+    SREG = oldSREG;
+    return true;
+}
+
+bool pulseTrainOutput::resume() {
+    if (!_isRunning || _pulseMode != DISCRETE) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    uint8_t oldSREG = SREG;
+    cli();
+    _pausePending = false;
+    if (_paused) {
+        _paused = false;
+        _setClock(_pausedClock);          // The count carries on where it stopped, so only the LOW half grew.
+    }
+    SREG = oldSREG;
+    return true;
+}
+
+bool pulseTrainOutput::abort(pulseTrainReport& report) {
+    uint8_t oldSREG = SREG;
+    cli();
+    if (!_isRunning) {
+        SREG = oldSREG;
+        report.emitted = 0;
+        report.remaining = 0;
+        report.truncated = false;
+        return false;
+    }
+    // Once the output is on "Clear" a match can only lower the pin, so the flag and level read next
+    // can't miss a rising edge. The forced compare then ends a HIGH half on a clean edge. Nothing
+    // else comes first, which is what bounds the latency. A WIDTH train leaves fast PWM for CTC in
+    // the same write, as FOCnA only works outside the PWM modes.
+    uint8_t pwmBits = (_pulseMode == WIDTH) ? _BV(WGM11) : 0;
+    *_tccrA = (*_tccrA & ~(_comStopMask | pwmBits)) | (_comStopMask & _BV(COM1A1));
+    uint8_t flags = *_tifr;
+    bool flagged = flags & (1 << _ocieBit);
+    bool high = *_inputPort & _pinBitMask;
+    *_tccrC |= _BV(FOC1A);
+    report.emitted = 0;
+    report.remaining = 0;
+    report.truncated = high;
+    uint32_t extra = 0;
+    int32_t position = _position;
+    bool width = false;
+    if (_pulseMode == DISCRETE || _pulseMode == MOVE) {
+        // A flagged match that left the pin HIGH raised it, and the interrupt hasn't counted it.
+        extra = (flagged && high && !_hardwareCounting && _postscaleLeft == 1) ? 1 : 0;
+        report.emitted = _pulsesEmitted() + extra;
+        report.remaining = _pulsesToGenerate / 2 - report.emitted;
+    } else if (_pulseMode == WIDTH && _pulsesToGenerate != 0) {
+        // The overflow counts a pulse once it ends. One that ended with its overflow still pending,
+        // or was cut short here, is added from what was read before the forced compare.
+        uint32_t counted = _pulsesToGenerate - _pulseCounter;
+        report.emitted = counted + ((counted < _pulsesToGenerate && ((flags & _BV(TOV1)) || high)) ? 1 : 0);
+        report.remaining = _pulsesToGenerate - report.emitted;
+        width = true;
+    }
+    stop();
+    if (width) {
+        // The pin can still read HIGH for a cycle after the forced compare, so stop()'s fold isn't used.
+        _position = position + ((_direction > 0) ? (int32_t)report.emitted : -(int32_t)report.emitted);
+    } else {
+        _position += (_direction > 0) ? (int32_t)extra : -(int32_t)extra;   // stop() only folds counted edges.
+    }
+    SREG = oldSREG;
+    return true;
+}
+#endif
+
+bool pulseTrainOutput::isPaused() const {
+    return _paused;
+}
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+void pulseTrainOutput::handleInterrupt() {
+        if (_resumeSkip) {
+            _resumeSkip = false;          // resume() made this overflow to rerun the held period.
+            return;
+        }
+#if PTO_ENABLE_STATISTICS
+        recordInterruptEntry();
+#endif
+        if (_dithering) {
+            // Buffered, so this sets the period after the one that has just started.
+            uint32_t accumulator = _ditherAccumulator + _ditherStep;
+            uint32_t period = _ditherTop + (accumulator < _ditherAccumulator);
+            _ditherAccumulator = accumulator;
+            _timer.set_period(period);
+            _setDuty(period / 2);
+        }
+        if (_pulseMode == DISCRETE || _pulseMode == MOVE || _pulseMode == WIDTH) {
+            if (_pulseCounter == 0) {
+                _finish();
+            }
+            if (_pulseCounter > 0) {
+                _pulseCounter--;
+                if (_pulseCounter == 0) {
+                    if (!_loadNextSegment()) {
+                        // Instead of stopping, we command the PWM to be silent for the next full cycle.
+                        // This holds the output pin low, creating our "final off cycle".
+                        _setDuty(0);
+                    }
+                } else if (_pulseMode == MOVE) {
+                    // The period and duty registers are buffered, so this takes effect at the next overflow.
+                    uint32_t period = _advanceRamp();
+                    _timer.set_period(period);
+                    _setDuty(period / 2);
+                }
+            }
+        } else if (_pulseMode == BURST) {
+            if (_burstGapLeft != 0) {
+                _advanceBurstGap();
+            } else if (_pulseCounter == 0) {
+                _finish();                // The silent period after the last burst has started.
+            } else if (--_pulseCounter == 0 && !_startBurstGap()) {
+                _setDuty(0);   // As DISCRETE: one silent period, then stop.
+            }
+        } else if (_pulseMode == STREAM) {
+            if (_streamArmed) {
+                _advanceStream();         // The DTC has finished a pass and handed this overflow on.
+            } else if (--_pulseCounter != 0) {
+                _setDuty(0);              // The last pulse has started. As DISCRETE: one silent period, then stop.
+            } else {
+                _finish();                // The silent period after the last pulse has started.
+            }
+        } else if (_pulseMode == TRACKING) {
+            _advanceTracking();           // Buffered, so a new period starts at the next overflow.
+        } else if (_pulseMode == PLAYBACK) {
+            if (_pulseCounter == 0) {
+                // The silent period after the last pulse has started.
+                _playDone = true;
+                _finish();
+            } else {
+                _loadPlaybackPeriod();
+            }
+        }
+        if (_pausePending && digitalRead(_pin) == LOW) {
+            _holdPaused();                // The period ended without the pin rising.
+        }
+#if PTO_ENABLE_STATISTICS
+        recordInterruptExit();
+#endif
+    }
+#else
+void pulseTrainOutput::handleInterrupt() {
+        if (_pulseMode == SCHEDULED) {
+            _scheduler->_service();
+            return;
+        }
+        bool edge = true;
+        if (_postscale > 1) {
+            // Below the timer's range only every _postscale-th match moves the pin. Swapping "Set" and
+            // "Clear" one match ahead makes the next match the edge, so it is still timed by hardware.
+            if (--_postscaleLeft != 0) {
+                edge = false;
+                if (_postscaleLeft == 1) {
+                    *_tccrA ^= _BV(COM1A0);
+                }
+            } else {
+                _postscaleLeft = _postscale;
+            }
+        }
+        if (edge && _updatePending && (_pulseMode > CONTINUOUS || (*_inputPort & _pinBitMask))) {
+            // Commit on the match that starts a HIGH half, so the period that just ended and the one
+            // starting now are each wholly old or wholly new.
+            _updatePending = false;
+            _dithering = false;
+            _applyTiming(_stagedTiming);
+            _setPostscale(_stagedTiming.postscale, *_inputPort & _pinBitMask);
+        }
+        if (_dithering) {
+            // The counter has only just cleared, so this sets the interval that started with this edge.
+            // The accumulator's carry picks the longer count often enough to make the average exact.
+            uint32_t accumulator = _ditherAccumulator + _ditherStep;
+            _writeOcr(_ditherTop + (accumulator < _ditherAccumulator));
+            _ditherAccumulator = accumulator;
+        }
+        if (!edge) {
+            return;
+        }
+        if (_pulseMode == COORDINATED) {
+            _advanceAxes();
+        } else if (_pulseMode == BURST && _burstGapLeft != 0) {
+            _advanceBurstGap();
+        } else if ((_pulseMode == DISCRETE && !_hardwareCounting) || _pulseMode == MOVE || _pulseMode == BURST) {
+            _pulseCounter--;
+            if (_pulseCounter == 1 && _queueHead == _queueTail && _postscale == 1) {
+                // This is the interrupt for the RISING edge of the very last pulse.
+                // We reconfigure the timer's NEXT action from "Toggle" to "Clear" (Force LOW).
+                // This must be done in a single, atomic operation to prevent a glitch.
+                
+                uint8_t currentTCCRA = *_tccrA;
+                // First, clear the existing COM bits (both 1 and 0)
+                currentTCCRA &= ~(_BV(COM1A1) | _BV(COM1A0));
+                // Then, set the new COM bits for "Clear on Compare Match" (COMxA1=1, COMxA0=0)
+                currentTCCRA |= _BV(COM1A1);
+                // Write the new configuration back to the register in one operation.
+                *_tccrA = currentTCCRA;
+
+            }//
+             else if (_pulseCounter == 0 && !(_pulseMode == BURST ? _startBurstGap() : _loadNextSegment())) {
+                _finish();
+            }
+            if (_pulseMode == MOVE && _pulseCounter != 0) {
+                // CTC compares are unbuffered, but the counter has only just cleared, so the new
+                // interval applies to the edge that follows this one.
+                _writeOcr(_advanceRamp() - 1);
+            } else if ((_pulseMode == DISCRETE || _pulseMode == BURST) && _isRunning && !_updatePending && !_dithering && _postscale == 1
+                       && !_pausePending) {
+                _delegateCount();
+            }
+        } else if (_pulseMode == TRACKING) {
+            // Commit on the match that starts a HIGH half, as updateFrequency() does. Once the target
+            // is reached the interrupt goes off until setTarget() posts another.
+            if ((*_inputPort & _pinBitMask) && !_advanceTracking() && _postscale == 1) {
+                *_timsk &= ~(1 << _ocieBit);
+            }
+        } else if (_pulseMode == PLAYBACK) {
+            _nextPlaybackPass();          // The vector plays the entries, and only calls here at the end of a pass.
+        } else if (!_updatePending && !_dithering && _postscale == 1 && !_pausePending) {
+            *_timsk &= ~(1 << _ocieBit);          // The interrupt was only enabled to commit an update or a pause.
+        }
+        if (_pausePending && !(*_inputPort & _pinBitMask)) {
+            _holdPaused();                // This edge ended a pulse.
+        }
+    }
+#endif
+
+
+bool pulseTrainOutput::isRunning() const{
+    return _isRunning;
+}
+
+uint8_t pulseTrainOutput::getError() const{
+    return _error;
+}
+
+bool pulseTrainOutput::useHardwareCounter(uint8_t counterPin) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    (void)counterPin;
+    _error = COUNTER_UNAVAILABLE;         // The R4 already interrupts once per pulse rather than once per edge.
+    return false;
+#else
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (counterPin != PTO_COUNTER_PIN) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (_timerId == TID_INVALID || _timerId == PTO_COUNTER_TIMER || _instances[PTO_COUNTER_TIMER] != nullptr
+        || (_counterOwner != nullptr && _counterOwner != this)) {
+        _error = COUNTER_UNAVAILABLE;
+        return false;
+    }
+    pinMode(counterPin, INPUT);
+    _counterOwner = this;
+    return true;
+#endif
+}
+
+void pulseTrainOutput::handleCounterInterrupt() {
 #if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
-bool pulseTrainOutput::_calculateTimingParameters(uint32_t frequency, uint32_t& ocrValue, uint8_t& prescalerBits) {
-    uint32_t maxOcr = _is16bit ? 0xFFFF : 0xFF;
-    if (_is16bit) {
-        ocrValue = (F_CPU / (2UL * frequency)) - 1; prescalerBits = _BV(CS10);
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 8 * frequency)) - 1; prescalerBits = _BV(CS11); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 64 * frequency)) - 1; prescalerBits = _BV(CS11) | _BV(CS10); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 256 * frequency)) - 1; prescalerBits = _BV(CS12); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 1024 * frequency)) - 1; prescalerBits = _BV(CS12) | _BV(CS10); }
+    if (_counterWraps != 0) {
+        _counterWraps--;
+        return;
+    }
+    // This is the RISING edge of the very last pulse. Make the output timer's next compare
+    // "Clear" instead of "Toggle", then let its own interrupt stop the train after that edge.
+    // If this interrupt was late and the falling edge already happened, the stale flag is
+    // discarded and the next compare (now a clear) ends the train with the count still exact.
+    _stopCounter();
+    _hardwareCounting = false;
+    *_tccrA = (*_tccrA & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A1);
+    _pulseCounter = 1;
+    *_tifr = (1 << _ocieBit);
+    PTO_MODEL_WRITE(_tifr);
+    *_timsk |= (1 << _ocieBit);
+#endif
+}
+
+bool pulseTrainOutput::addPhaseOutput(uint8_t pin, uint16_t phaseDegrees) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (phaseDegrees >= 360) {
+        _error = INVALID_PHASE;
+        return false;
+    }
+    uint8_t index = 0;
+    while (index < _phaseCount && _phasePins[index] != pin) {
+        index++;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    // A GPT pin only changes at its compare and at the end of the period, so the other pin of the
+    // channel can copy the output or invert it, but not shift it.
+    if (phaseDegrees != 0 && phaseDegrees != 180) {
+        _error = INVALID_PHASE;
+        return false;
+    }
+    auto pin_cfg = getPinCfgs(pin, PIN_CFG_REQ_PWM);
+    bool onA = IS_PWM_ON_A(pin_cfg[0]);
+    if (_timerId == TID_INVALID || _is_agt || pin_cfg[0] == 0 || IS_PIN_AGT_PWM(pin_cfg[0])
+        || GET_CHANNEL(pin_cfg[0]) != _timer_channel || onA == (_pwm_channel == CHANNEL_A)) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    R_IOPORT_PinCfg(&g_ioport_ctrl, g_pin_cfg[pin].pin, (uint32_t)(IOPORT_CFG_PERIPHERAL_PIN | IOPORT_PERIPHERAL_GPT1));
+#else
+    timerIds timerId = TID_INVALID;
+    volatile uint8_t* ocr = nullptr;
+    volatile uint8_t* port = nullptr;
+    uint8_t mask = 0;
+    uint8_t com = _BV(COM1B0);
+    uint8_t foc = _BV(FOC1B);             // The COM and FOC bits of channels B and C sit at the same positions on every timer.
+    #if defined(__AVR_ATmega2560__)
+        switch (pin) {
+            case 12: timerId = TID_TIMER1; ocr = (volatile uint8_t*)&OCR1B; port = &PORTB; mask = _BV(PB6); break;
+            case 13: timerId = TID_TIMER1; ocr = (volatile uint8_t*)&OCR1C; port = &PORTB; mask = _BV(PB7); com = _BV(COM1C0); foc = _BV(FOC1C); break;
+            case 9: timerId = TID_TIMER2; ocr = &OCR2B; port = &PORTH; mask = _BV(PH6); break;
+            case 2: timerId = TID_TIMER3; ocr = (volatile uint8_t*)&OCR3B; port = &PORTE; mask = _BV(PE4); break;
+            case 3: timerId = TID_TIMER3; ocr = (volatile uint8_t*)&OCR3C; port = &PORTE; mask = _BV(PE5); com = _BV(COM1C0); foc = _BV(FOC1C); break;
+            case 7: timerId = TID_TIMER4; ocr = (volatile uint8_t*)&OCR4B; port = &PORTH; mask = _BV(PH4); break;
+            case 8: timerId = TID_TIMER4; ocr = (volatile uint8_t*)&OCR4C; port = &PORTH; mask = _BV(PH5); com = _BV(COM1C0); foc = _BV(FOC1C); break;
+            case 45: timerId = TID_TIMER5; ocr = (volatile uint8_t*)&OCR5B; port = &PORTL; mask = _BV(PL4); break;
+            case 44: timerId = TID_TIMER5; ocr = (volatile uint8_t*)&OCR5C; port = &PORTL; mask = _BV(PL5); com = _BV(COM1C0); foc = _BV(FOC1C); break;
+        }
+    #else // Arduino Uno, Nano, etc.
+        switch (pin) {
+            case 10: timerId = TID_TIMER1; ocr = (volatile uint8_t*)&OCR1B; port = &PORTB; mask = _BV(PB2); break;
+            case 3: timerId = TID_TIMER2; ocr = &OCR2B; port = &PORTD; mask = _BV(PD3); break;
+        }
+    #endif
+    if (timerId == TID_INVALID || timerId != _timerId) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    _phaseOcr[index] = ocr;
+    _phasePorts[index] = port;
+    _phaseMasks[index] = mask;
+    _phaseCom[index] = com;
+    _phaseFoc[index] = foc;
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+#endif
+    _phasePins[index] = pin;
+    _phaseDegrees[index] = phaseDegrees;
+    if (index == _phaseCount) {
+        _phaseCount++;
+    }
+    return true;
+}
+
+void pulseTrainOutput::clearPhaseOutputs() {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (_isRunning && _phaseRunning) {
+        stop();                           // The GPT channel was opened with both pins; see clearAxes().
+    }
+    _phaseCount = 0;
+#else
+    uint8_t oldSREG = SREG;
+    cli();
+    if (_phaseRunning) {
+        _stopPhaseOutputs();
+    }
+    _phaseCount = 0;
+    SREG = oldSREG;
+#endif
+}
+
+bool pulseTrainOutput::addAxis(uint8_t stepPin) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    (void)stepPin;
+    _error = INVALID_MODE;                // The R4 has no PORTx registers to write; see moveAxes().
+    return false;
+#else
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_axisCount >= PTO_MAX_AXES) {
+        _error = AXIS_LIMIT;
+        return false;
+    }
+    uint8_t port = digitalPinToPort(stepPin);
+    if (port == NOT_A_PIN) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    volatile uint8_t* out = portOutputRegister(port);
+    uint8_t portIndex = 0;
+    while (portIndex < _axisPortCount && _axisPorts[portIndex] != out) {
+        portIndex++;
+    }
+    if (portIndex == _axisPortCount) {
+        _axisPorts[_axisPortCount++] = out;
+    }
+    ddaAxis& axis = _axes[_axisCount++];
+    axis.portIndex = portIndex;
+    axis.pinBitMask = digitalPinToBitMask(stepPin);
+    axis.steps = 0;
+    digitalWrite(stepPin, LOW);
+    pinMode(stepPin, OUTPUT);
+    return true;
+#endif
+}
+
+void pulseTrainOutput::clearAxes() {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    if (_isRunning && _pulseMode == COORDINATED) {
+        stop();
+    }
+    _axisCount = 0;
+    _axisPortCount = 0;
+#endif
+}
+
+bool pulseTrainOutput::moveAxes(const uint32_t steps[], uint32_t frequency) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    (void)steps;
+    (void)frequency;
+    _error = INVALID_MODE;
+    return false;
+#else
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    uint32_t major = 0;
+    for (uint8_t i = 0; i < _axisCount; i++) {
+        if (steps[i] > major) {
+            major = steps[i];
+        }
+    }
+    if (major == 0) {
+        _error = ZERO_PULSES;
+        return false;
+    }
+    pulseTiming timing;
+    if (!_calculateTimingParameters(frequency, timing)) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    for (uint8_t i = 0; i < _axisCount; i++) {
+        _axes[i].steps = steps[i];
+        _axes[i].accumulator = major / 2;  // Starting half way centres each minor axis's steps in the move.
+    }
+    for (uint8_t i = 0; i < _axisPortCount; i++) {
+        _axisRaised[i] = 0;
+    }
+    _majorSteps = major;
+    _pulseCounter = major;
+    _pulsesToGenerate = major;
+    _axisHigh = false;
+    _pulseMode = COORDINATED;
+    _requestedFrequency = frequency;
+    _startTimer(timing, true, false);     // The pin's own timer output isn't an axis; the interrupt writes the ports.
+    return true;
+#endif
+}
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+void pulseTrainOutput::_advanceAxes() {
+    if (_axisHigh) {
+        for (uint8_t i = 0; i < _axisPortCount; i++) {
+            *_axisPorts[i] &= ~_axisRaised[i];
+            _axisRaised[i] = 0;
+        }
+        _axisHigh = false;
+        if (--_pulseCounter == 0) {
+            _finish();
+        }
+        return;
+    }
+    // Every axis adds its step count each major step and steps whenever the total passes the
+    // major count, so an axis with the full count steps every time and the others are spread evenly.
+    uint32_t major = _majorSteps;
+    for (uint8_t i = 0; i < _axisCount; i++) {
+        ddaAxis& axis = _axes[i];
+        axis.accumulator += axis.steps;
+        if (axis.accumulator >= major) {
+            axis.accumulator -= major;
+            _axisRaised[axis.portIndex] |= axis.pinBitMask;
+        }
+    }
+    for (uint8_t i = 0; i < _axisPortCount; i++) {
+        *_axisPorts[i] |= _axisRaised[i];
+    }
+    _axisHigh = true;
+}
+#endif
+
+bool pulseTrainOutput::queue(uint32_t frequency, uint32_t pulses) {
+    if (!_isRunning) {
+        return generate(frequency, DISCRETE, pulses);
+    }
+    pulseTiming timing;
+    if (!calculateTiming(frequency, timing)) {
+        return false;
+    }
+    return queue(timing, pulses);
+}
+
+bool pulseTrainOutput::queue(const pulseTiming& timing, uint32_t pulses) {
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (_isRunning && _pulseMode != DISCRETE) {
+        _error = INVALID_MODE;            // Only a DISCRETE train ends where a segment can follow.
+        return false;
+    }
+    if (pulses == 0) {
+        _error = ZERO_PULSES;
+        return false;
+    }
+    uint8_t head = _queueHead;
+    uint8_t next = (head + 1) & (PTO_SEGMENT_QUEUE_SIZE - 1);
+    if (next == _queueTail) {
+        _error = QUEUE_FULL;
+        return false;
+    }
+    _queue[head].timing = timing;
+    _queue[head].pulses = pulses;
+    _queueHead = next;                    // Publishing the slot is a single byte store, so the ISR sees all or nothing.
+
+    // The train may have ended between the caller's last look and the store above, in which
+    // case the ISR won't run again to pick the segment up. Start it from here instead.
+    interruptState state = saveInterrupts();   // A completion callback may queue the next segment.
+    bool stranded = !_isRunning && _queueHead != _queueTail;
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    if (_isRunning && _pulseMode == DISCRETE) {
+        ptoFinish[_timerId] = 0;          // The train no longer ends with the pulses the fast path holds.
+    }
+#endif
+    restoreInterrupts(state);
+    if (stranded) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+        // The R4 settings are tied to the divider of a running timer, so they can't restart it.
+        _queueTail = _queueHead;
+        _error = INVALID_MODE;
+        return false;
+#else
+        pulseSegment segment = _queue[_queueTail];
+        _queueTail = (_queueTail + 1) & (PTO_SEGMENT_QUEUE_SIZE - 1);
+        _pulseMode = DISCRETE;
+        _pulsesToGenerate = segment.pulses * 2;
+        _pulseCounter = _pulsesToGenerate;
+        _startTimer(segment.timing, true);
+#endif
+    }
+    return true;
+}
+
+uint8_t pulseTrainOutput::queuedSegments() const {
+    return (_queueHead - _queueTail) & (PTO_SEGMENT_QUEUE_SIZE - 1);
+}
+
+bool pulseTrainOutput::_loadNextSegment() {
+    uint8_t tail = _queueTail;
+    if (tail == _queueHead) {
+        return false;
+    }
+    const pulseSegment& segment = _queue[tail];
+    _foldPosition();                      // Every pulse of the train that just ended has left.
+    _pulseMode = DISCRETE;
+    _dithering = false;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    // Buffered, so the new period starts at the next overflow, straight after the current pulse.
+    _pulsesToGenerate = segment.pulses;
+    _timer.set_period(segment.timing.top);
+    _setDuty(segment.timing.top / 2);
+#else
+    // The falling edge of the last pulse has just happened and the counter has only just cleared,
+    // so the new OCR and prescaler time the low half of the segment's first pulse.
+    _pulsesToGenerate = segment.pulses * 2;
+    _updatePending = false;               // A staged update belonged to the train that just ended.
+    _applyTiming(segment.timing);
+    // The last pulse may have switched the output to "Clear on Compare Match". Go back to toggling,
+    // or to holding LOW if the segment is postscaled.
+    _setPostscale(segment.timing.postscale, false);
+#endif
+    _pulseCounter = _pulsesToGenerate;
+    _queueTail = (tail + 1) & (PTO_SEGMENT_QUEUE_SIZE - 1);
+    return true;
+}
+
+void pulseTrainOutput::_finish() {
+    stop();
+    _completed = true;
+    if (_onComplete != nullptr) {
+        _onComplete(*this);
+    }
+}
+
+uint32_t pulseTrainOutput::_pulsesEmitted() const {
+    if (!_isRunning || (_pulseMode != DISCRETE && _pulseMode != MOVE && _pulseMode != BURST && _pulseMode != WIDTH
+        && _pulseMode != STREAM)) {
+        return 0;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (_streamArmed) {
+        // Each overflow ends a pulse as the DTC buffers another. The pulse playing, the one in the buffer
+        // and what's left of the pass are all that haven't ended.
+        return _pulsesToGenerate - 2 - _dtcInfo[0].length;
+    }
+    // The callback counts a pulse down as its period ends. A CONTINUOUS WIDTH train has no count.
+    return _pulsesToGenerate - _pulseCounter;
+#else
+    if (_pulseMode == WIDTH) {
+        // The overflow counts a pulse down as it ends. One that's HIGH now, or has ended with its
+        // overflow still pending, has left too.
+        uint32_t emitted = _pulsesToGenerate - _pulseCounter;
+        if (emitted < _pulsesToGenerate && ((*_tifr & _BV(TOV1)) || (*_inputPort & _pinBitMask))) {
+            emitted++;
+        }
+        return emitted;
+    }
+    if (_hardwareCounting) {
+        // The counter timer has counted the rising edges. _armCounter() set it to match after the
+        // first target of them and every 65536 after, and each match taken is one off _counterWraps.
+        uint32_t target = _pulsesToGenerate / 2 - 1;
+        uint16_t compare = target & 0xFFFF;
+        uint16_t wraps = (target >> 16) - (compare == 0);
+        uint16_t count;
+        uint8_t flags;
+        do {
+            count = PTO_COUNTER_TCNT;
+            flags = PTO_COUNTER_TIFR;
+        } while (count != PTO_COUNTER_TCNT);
+        uint16_t matches = wraps - _counterWraps + ((flags & _BV(PTO_COUNTER_OCF)) != 0);
+        uint32_t overflows;
+        if (compare == 0) {
+            // The match at the first count was blocked by the write to TCNT, so every match taken
+            // followed an overflow. The overflow flag tells 65536 edges from none.
+            overflows = matches + (count == 0 && (flags & _BV(PTO_COUNTER_TOV)));
+        } else {
+            overflows = (count > compare) ? matches - 1 : matches;
+        }
+        return (overflows << 16) + count;
+    }
+    // The toggles still to come are split between _pulseCounter and the fast path's counts. The
+    // first toggle of every pulse raises the pin, so a pulse counts as soon as its rising edge leaves.
+    uint32_t remaining = _pulseCounter + ((uint32_t)ptoFastReload[_timerId] << 16) + ptoFastCount[_timerId];
+    return (_pulsesToGenerate - remaining + 1) / 2;
+#endif
+}
+
+void pulseTrainOutput::_foldPosition() {
+    uint32_t emitted = _pulsesEmitted();
+    _position += (_direction > 0) ? (int32_t)emitted : -(int32_t)emitted;
+    _pulsesToGenerate = 0;                // So the same pulses can't be folded in twice.
+    _pulseCounter = 0;
+}
+
+bool pulseTrainOutput::setDirectionPin(uint8_t pin, uint16_t setupMicros) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    _directionPin = pin;
+    _directionSetupUs = setupMicros;
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, (_direction > 0) ? HIGH : LOW);
+    return true;
+}
+
+bool pulseTrainOutput::setDirection(bool forward) {
+    if (_isRunning) {
+        _error = ACTIVE;                  // Reversing mid-train would put pulses on the wrong side of the count.
+        return false;
+    }
+    int8_t direction = forward ? 1 : -1;
+    if (direction == _direction) {
+        return true;
+    }
+    _direction = direction;
+    if (_directionPin != 0xFF) {
+        digitalWrite(_directionPin, forward ? HIGH : LOW);
+        delayMicroseconds(_directionSetupUs);   // The driver samples DIR on the next step edge.
+    }
+    return true;
+}
+
+int32_t pulseTrainOutput::getPosition() const {
+    interruptState state = saveInterrupts();
+    uint32_t emitted = _pulsesEmitted();
+    int32_t position = _position + ((_direction > 0) ? (int32_t)emitted : -(int32_t)emitted);
+    restoreInterrupts(state);
+    return position;
+}
+
+bool pulseTrainOutput::setPosition(int32_t position) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    _position = position;
+    return true;
+}
+
+uint32_t pulseTrainOutput::getPulsesEmitted() const {
+    interruptState state = saveInterrupts();
+    uint32_t emitted = _pulsesEmitted();
+    restoreInterrupts(state);
+    return emitted;
+}
+
+void pulseTrainOutput::onComplete(completionCallback callback) {
+    interruptState state = saveInterrupts();   // A pointer is two stores on AVR, so don't let the ISR see half of one.
+    _onComplete = callback;
+    restoreInterrupts(state);
+}
+
+bool pulseTrainOutput::pollComplete() {
+    interruptState state = saveInterrupts();
+    bool completed = _completed;
+    _completed = false;
+    restoreInterrupts(state);
+    return completed;
+}
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+bool pulseTrainOutput::_calculateTimingParameters(uint32_t frequency, pulseTiming& timing) {
+    if (avrSolveTiming(_is16bit, frequency, timing)) {
+        return true;
+    }
+    if (frequency == 0 || frequency > F_CPU / 2UL) {
+        return false;
+    }
+    // Below the timer's range. Split each half period into the fewest equal matches that fit at the
+    // largest prescaler, and let the interrupt move the pin on the last of them.
+    uint32_t longest = _is16bit ? (0x10000UL << timer16Shift[5]) : (0x100UL << timer8Shift[7]);
+    uint32_t postscale = (F_CPU / (2UL * frequency)) / longest + 1;
+    if (postscale > 0xFFFF || !avrSolveTiming(_is16bit, frequency * postscale, timing)) {
+        return false;
+    }
+    timing.postscale = postscale;
+    return true;
+}
+
+bool avrSolveTiming(bool is16bit, uint32_t frequency, pulseTiming& timing, uint8_t minBits) {
+    // Above F_CPU / 2 the OCR value would be negative.
+    if (frequency == 0 || frequency > F_CPU / 2UL) {
+        return false;
+    }
+    // One division gives the ideal half period in CPU cycles, D + R / 2f. Every divider is a power
+    // of two, so the counts either side of the ideal for each prescaler follow from D with shifts
+    // alone: floor((D + R / 2f) / 2^s) == (2D + (R >= f)) >> (s + 1).
+    uint32_t twiceFrequency = 2UL * frequency;
+    uint32_t twiceCycles = 2UL * (F_CPU / twiceFrequency) + (F_CPU % twiceFrequency >= frequency);
+    const uint8_t* shifts = is16bit ? timer16Shift : timer8Shift;
+    uint8_t maxBits = is16bit ? 5 : 7;
+    uint32_t maxCounts = is16bit ? 0x10000UL : 0x100UL;
+
+    uint32_t bestCycles = 0;
+    uint32_t bestError = 0;
+    for (uint8_t bits = minBits; bits <= maxBits; bits++) {
+        uint8_t shift = shifts[bits];
+        uint32_t below = twiceCycles >> (shift + 1);
+        if (below == 0) {
+            break;                        // Under one count, and every larger divider is coarser still.
+        }
+        // The nearer count in time isn't always the nearer in frequency, so try both neighbours.
+        for (uint32_t counts = below; counts <= below + 1; counts++) {
+            if (counts > maxCounts) {
+                continue;
+            }
+            // The frequency error is |F_CPU - 2f * cycles| / (2 * cycles), so compare candidates by
+            // cross-multiplying. The ideal is at least one count, so 2f * cycles <= 2 * F_CPU.
+            uint32_t cycles = counts << shift;
+            uint32_t produced = twiceFrequency * cycles;
+            uint32_t error = (produced > F_CPU) ? produced - F_CPU : F_CPU - produced;
+            // Strictly better only, so a tie keeps the smaller prescaler and its finer steps.
+            if (bestCycles == 0 || (uint64_t)error * bestCycles < (uint64_t)bestError * cycles) {
+                bestCycles = cycles;
+                bestError = error;
+                timing.top = counts - 1;
+                timing.prescalerBits = bits;
+            }
+        }
+    }
+    timing.postscale = 1;
+    return bestCycles != 0;
+}
+
+// The timer count rate (F_CPU / N) selected by a set of CS bits.
+static uint32_t avrTimerClock(bool is16bit, uint8_t prescalerBits) {
+    if (prescalerBits == 0 || prescalerBits > (is16bit ? 5 : 7)) {
+        return 0;                         // Stopped, or clocked from the Tn pin.
+    }
+    return F_CPU >> (is16bit ? timer16Shift : timer8Shift)[prescalerBits];
+}
+#else
+// The raw GPT/AGT count rate for the clock divider chosen when the timer was opened.
+static uint32_t r4TimerClock(FspTimer& timer, bool isAgt) {
+    uint32_t sourceClock = R_FSP_SystemClockHzGet(isAgt ? FSP_PRIV_CLOCK_PCLKB : FSP_PRIV_CLOCK_PCLKD);
+    return sourceClock >> timer.get_cfg()->source_div;
+}
+
+bool pulseTrainOutput::_calculateTimingParameters(uint32_t frequency, pulseTiming& timing) {
+    if (frequency == 0 || !_isRunning) {
+        return false;
+    }
+    // GPT0 and GPT1 are the 32-bit channels. Every other GPT channel and the AGTs are 16-bit.
+    uint32_t maxCounts = (!_is_agt && _timer_channel < 2) ? 0xFFFFFFFFUL : 0x10000UL;
+    uint64_t error;
+    uint32_t counts = nearestCounts(r4TimerClock(_timer, _is_agt), frequency, maxCounts, error);
+    if (counts == 0) {
+        return false;
+    }
+    timing.top = counts;
+    timing.prescalerBits = 0;
+    timing.postscale = 1;
+    return true;
+}
+#endif
+
+float pulseTrainOutput::getActualFrequency() const {
+    if (!_isRunning) {
+        return 0;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    FspTimer& timer = const_cast<FspTimer&>(_timer);      // FspTimer's getters aren't const.
+    float counts = _dithering ? _ditherTop + _ditherStep / 4294967296.0f : timer.get_period_raw();
+    if (_pulseMode == BURST) {
+        counts = _burstTop;               // Not the gap's period.
+    }
+    return r4TimerClock(timer, _is_agt) / counts;
+#else
+    uint8_t oldSREG = SREG;
+    cli();
+    pulseTiming timing = _stagedTiming;
+    bool staged = _updatePending;
+    bool dithering = _dithering;
+    if (!staged) {
+        timing.top = dithering ? _ditherTop : (_pulseMode == BURST ? _burstTop : _readOcr());
+        timing.prescalerBits = *_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10));
+        timing.postscale = _postscale;
+    }
+    if (_pulseMode == WIDTH) {
+        // A whole period is TOP + 1 counts. An update still on its way reads as landed.
+        uint16_t top = staged ? _widthStagedTop : (_widthTopPending ? _widthNextTop : *_icr);
+        SREG = oldSREG;
+        return avrTimerClock(true, *_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10))) / (top + 1.0f);
+    }
+    SREG = oldSREG;
+    // The output toggles once per match (or per postscale matches), so a period is two runs of (top + 1) counts each.
+    float counts = timing.top + 1.0f;
+    if (dithering && !staged) {
+        counts += _ditherStep / 4294967296.0f;
+    }
+    if (timing.postscale > 1) {
+        counts *= timing.postscale;
+    }
+    return avrTimerClock(_is16bit, timing.prescalerBits) / (2.0f * counts);
+#endif
+}
+
+float pulseTrainOutput::getFrequencyError() const {
+    interruptState state = saveInterrupts();   // track() moves the request from the interrupt.
+    float requested = _requestedFrequency;
+    restoreInterrupts(state);
+    if (!_isRunning || requested == 0) {
+        return 0;
+    }
+    return getActualFrequency() - requested;
+}
+
+#if PTO_ENABLE_STATISTICS
+void pulseTrainOutput::getStatistics(pulseTrainStatistics& stats) const {
+    interruptState state = saveInterrupts();
+    stats.pulses = _statsPulses;
+    stats.interrupts = _statsInterrupts;
+    stats.missed = _statsMissed;
+    stats.maxLatency = _statsMaxLatency;
+    stats.maxDuration = _statsMaxDuration;
+    uint32_t total = _statsDurationTotal;
+    uint32_t timed = _statsTimed;
+    restoreInterrupts(state);
+    stats.meanDuration = timed ? total / timed : 0;
+    stats.cyclesPerCount = 0;
+    if (_isRunning) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+        FspTimer& timer = const_cast<FspTimer&>(_timer);  // FspTimer's getters aren't const.
+        stats.cyclesPerCount = R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_ICLK) / r4TimerClock(timer, _is_agt);
+#else
+        uint32_t clock = avrTimerClock(_is16bit, *_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10)));
+        stats.cyclesPerCount = clock ? F_CPU / clock : 0;
+#endif
+    }
+}
+
+void pulseTrainOutput::resetStatistics() {
+    interruptState state = saveInterrupts();
+    _statsPulses = 0;
+    _statsInterrupts = 0;
+    _statsMissed = 0;
+    _statsDurationTotal = 0;
+    _statsTimed = 0;
+    _statsMaxLatency = 0;
+    _statsMaxDuration = 0;
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    _statsLastHigh = false;
+#endif
+    restoreInterrupts(state);
+}
+
+void pulseTrainOutput::recordInterruptEntry() {
+    // The counter restarted at the match (AVR CTC) or overflow (R4), so it holds the time since.
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint32_t now = _timer.get_counter();
+#else
+    uint32_t now = _readCounter();
+#endif
+    _statsEntry = now;
+    if (now > _statsMaxLatency) {
+        _statsMaxLatency = now > 0xFFFF ? 0xFFFF : now;
+    }
+}
+
+void pulseTrainOutput::recordInterruptExit() {
+    _statsInterrupts++;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (!_isRunning) {
+        return;                           // stop() closed the timer. The final, silent period has no pulse.
+    }
+    _statsPulses++;                       // Each callback ends one period, so one pulse.
+    uint32_t now = _timer.get_counter();
+    uint32_t duration = now - _statsEntry;
+    if (now < _statsEntry) {
+        _statsMissed++;                   // The counter overflowed again before the handler finished.
+        duration += _timer.get_period_raw();
+    }
+#else
+    bool high = *_inputPort & _pinBitMask;
+    bool edge = (_postscale == 1 || _postscaleLeft == _postscale);
+    if (high && edge) {
+        _statsPulses++;                   // This match raised the pin.
+    }
+    if (_pulseMode == COORDINATED || _pulseMode >= BURST || _postscale > 1) {
+        // The pin doesn't alternate on every match, so count the matches that came before this handler finished.
+        if (*_tifr & (1 << _ocieBit)) {
+            _statsMissed++;
+        }
+    } else if (high == _statsLastHigh) {
+        _statsMissed++;                   // The pin didn't alternate, so a match went by unhandled.
+    }
+    _statsLastHigh = high;
+    if (!_isRunning) {
+        return;                           // stop() froze the counter, so this one can't be timed.
+    }
+    uint32_t now = _readCounter();
+    uint32_t duration = now < _statsEntry ? now + _readOcr() + 1 - _statsEntry : now - _statsEntry;
+#endif
+    if (duration > _statsMaxDuration) {
+        _statsMaxDuration = duration > 0xFFFF ? 0xFFFF : duration;
+    }
+    _statsDurationTotal += duration;
+    _statsTimed++;
+}
+#endif
+
+/**
+ * @brief Works out how many pulses each phase of an acceleration ramp from v0 to v1 takes.
+ * Phase 0 builds acceleration at 'jerk', phase 1 holds it and phase 2 eases it off again.
+ * Without jerk the whole ramp is phase 1. This only runs when a move is planned, so floats are fine.
+ * @return The peak acceleration reached, which is lower than 'accel' on short S-curves.
+ */
+static float planRamp(float v0, float v1, float accel, float jerk, float phase[3]) {
+    phase[0] = phase[1] = phase[2] = 0;
+    float dv = v1 - v0;
+    if (dv <= 0 || accel <= 0) {
+        return 0;
+    }
+    if (jerk <= 0) {
+        phase[1] = (v1 * v1 - v0 * v0) / (2 * accel);
+        return accel;
+    }
+    float peak = accel;
+    float holdTime = 0;
+    if (dv < accel * accel / jerk) {
+        peak = sqrt(jerk * dv);               // Acceleration never gets to 'accel' before it has to ease off.
+    } else {
+        holdTime = (dv - accel * accel / jerk) / accel;
+    }
+    float jerkTime = peak / jerk;
+    float vA = v0 + peak * jerkTime / 2;      // Speed once acceleration has built up.
+    float vB = vA + peak * holdTime;          // Speed once the constant acceleration ends.
+    phase[0] = v0 * jerkTime + jerk * jerkTime * jerkTime * jerkTime / 6;
+    phase[1] = vA * holdTime + peak * holdTime * holdTime / 2;
+    phase[2] = vB * jerkTime + peak * jerkTime * jerkTime / 2 - jerk * jerkTime * jerkTime * jerkTime / 6;
+    return peak;
+}
+
+bool pulseTrainOutput::move(uint32_t steps, uint32_t vStart, uint32_t vMax, uint32_t accel, uint32_t jerk) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (vStart == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    if (steps == 0) {
+        _error = ZERO_PULSES;
+        return false;
+    }
+    if (vMax < vStart) {
+        vMax = vStart;
+    }
+
+    // --- Plan the ramp in pulses ---
+    float phase[3];
+    float cruise = vMax;
+    float peak = planRamp(vStart, vMax, accel, jerk, phase);
+    if (2 * (phase[0] + phase[1] + phase[2]) > steps) {
+        if (jerk == 0) {
+            phase[1] = steps / 2;             // A triangle: decelerate as soon as half the pulses are out.
+        } else {
+            // Cutting an S-curve short would jump the acceleration, so find the highest cruise speed that fits.
+            float low = vStart;
+            float high = vMax;
+            for (uint8_t i = 0; i < 24; i++) {
+                float mid = (low + high) / 2;
+                planRamp(vStart, mid, accel, jerk, phase);
+                if (2 * (phase[0] + phase[1] + phase[2]) <= steps) {
+                    low = mid;
+                } else {
+                    high = mid;
+                }
+            }
+            cruise = low;
+            peak = planRamp(vStart, cruise, accel, jerk, phase);
+        }
+    }
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    const uint8_t intervalsPerPulse = 1;      // One overflow interrupt per pulse.
+    if (!_openTimer(vStart, MOVE)) {
+        return false;
+    }
+    uint32_t clock = r4TimerClock(_timer, _is_agt);
+    _rampScale = 0;
+    while (((clock / vStart) >> _rampScale) > 0xFFFF) {
+        _rampScale++;
+    }
+#else
+    const uint8_t intervalsPerPulse = 2;      // One compare interrupt per toggle.
+    pulseTiming timing;
+    if (!_calculateTimingParameters(vStart, timing) || timing.postscale > 1) {
+        _error = FREQUENCY_HIGH;          // The ramp writes every interval itself, so it can't be postscaled.
+        return false;
+    }
+    uint32_t clock = avrTimerClock(_is16bit, timing.prescalerBits);
+    _rampScale = 0;
+#endif
+
+    // --- Convert the plan to interrupt intervals ---
+    uint32_t total = steps * intervalsPerPulse;
+    uint32_t lengths[3];
+    uint32_t ramp = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        lengths[i] = (uint32_t)(phase[i] * intervalsPerPulse + 0.5f);
+        ramp += lengths[i];
+    }
+    // Rounding may leave the two ramps overlapping by an interval or two, so trim the middle phase first.
+    for (uint8_t i = 1; 2 * ramp > total; i = (i + 1) % 3) {
+        if (lengths[i] > 0) {
+            lengths[i]--;
+            ramp--;
+        }
+    }
+    // Deceleration mirrors acceleration, so its phases run in reverse order.
+    _rampBoundary[0] = lengths[0];
+    _rampBoundary[1] = _rampBoundary[0] + lengths[1];
+    _rampBoundary[2] = ramp;
+    _rampBoundary[3] = total - ramp;
+    _rampBoundary[4] = _rampBoundary[3] + lengths[2];
+    _rampBoundary[5] = _rampBoundary[4] + lengths[1];
+
+    // --- Fixed-point ramp constants ---
+    // With T counts per interval and F counts per second, one interval at acceleration 'a' (in
+    // intervals/s^2) changes the speed by the fraction a * T^2 / F^2. Holding a / F^2 as a 32-bit
+    // mantissa and a binary exponent keeps the per-interval update to multiplies and shifts.
+    float countsPerSecond = (float)clock / (float)(1UL << _rampScale);
+    float periodMax = countsPerSecond / ((float)vStart * intervalsPerPulse);
+    float periodMin = countsPerSecond / (cruise * intervalsPerPulse);
+    _rampPeriodMax = (periodMax >= 65535.0f) ? 0xFFFF0000UL : (uint32_t)(periodMax * 65536.0f);
+    _rampPeriodMin = (periodMin <= 1.0f) ? 0x10000UL : (uint32_t)(periodMin * 65536.0f);
+    if (_rampPeriodMin > _rampPeriodMax) {
+        _rampPeriodMin = _rampPeriodMax;
+    }
+    _rampPeriod = _rampPeriodMax;
+
+    int exponent = 0;
+    float mantissa = frexp(peak * intervalsPerPulse / (countsPerSecond * countsPerSecond), &exponent);
+    if (mantissa == 0 || exponent < -63) {
+        _rampAccelPeak = 0;
+        _rampShift = 0;
+    } else if (exponent > 0) {
+        _rampAccelPeak = 0xFFFFFFFFUL;        // An absurd acceleration: jump straight to the limits.
+        _rampShift = 0;
+    } else {
+        float scaled = ldexp(mantissa, 32);
+        _rampAccelPeak = (scaled >= 4294967295.0f) ? 0xFFFFFFFFUL : (uint32_t)scaled;
+        _rampShift = -exponent;
+    }
+    _rampJerkUp = lengths[0] ? _rampAccelPeak / lengths[0] : _rampAccelPeak;
+    _rampJerkDown = lengths[2] ? _rampAccelPeak / lengths[2] : _rampAccelPeak;
+    _rampAccel = 0;
+    _rampPhase = 0;
+
+    _pulseMode = MOVE;
+    _requestedFrequency = 0;              // The frequency follows the ramp, so there is nothing to compare against.
+    _pulsesToGenerate = total;
+    _pulseCounter = _pulsesToGenerate;
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint32_t period = (_rampPeriod >> 16) << _rampScale;
+    _timer.set_period(period);
+    _setDuty(period / 2);
+    _timer.start();
+    _isRunning = true;
+#else
+    timing.top = (_rampPeriod >> 16) - 1;
+    _startTimer(timing, true);
+#endif
+    return true;
+}
+
+// Reads one entry of a play() table, which lives in program memory on AVR.
+static inline uint16_t readInterval(const uint16_t* entry) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    return *entry;
+#else
+    return pgm_read_word(entry);
+#endif
+}
+
+bool pulseTrainOutput::play(const uint16_t intervals[], uint16_t length, uint16_t divider, uint16_t repeats) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (intervals == nullptr || length == 0 || (length & 1)) {
+        _error = INVALID_TABLE;
+        return false;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (_is_agt) {
+        _error = INVALID_MODE;            // The AGT dividers differ, and playback needs the GPT's buffered period.
+        return false;
+    }
+    int8_t sourceDiv = -1;
+    for (uint8_t div = 0; div <= 10; div += 2) {
+        if (divider == (1U << div)) {
+            sourceDiv = div;
+        }
+    }
+    uint32_t maxEntry = (_timer_channel < 2) ? 0xFFFF : 0x8000;
+    bool invalidDivider = (sourceDiv < 0);
+#else
+    pulseTiming timing;
+    timing.prescalerBits = 0;
+    timing.postscale = 1;
+    const uint8_t* shifts = _is16bit ? timer16Shift : timer8Shift;
+    for (uint8_t bits = 1; bits <= (_is16bit ? 5 : 7); bits++) {
+        if (divider == (1U << shifts[bits])) {
+            timing.prescalerBits = bits;
+        }
+    }
+    uint32_t maxEntry = _is16bit ? 0xFFFF : 0x100;
+    bool invalidDivider = (timing.prescalerBits == 0);
+#endif
+    if (invalidDivider) {
+        _error = INVALID_TABLE;
+        return false;
+    }
+    // One pass over the table up front is cheap next to playing it, and the interrupt can't check.
+    for (uint16_t i = 0; i < length; i++) {
+        uint16_t entry = readInterval(&intervals[i]);
+        if (entry == 0 || entry > maxEntry) {
+            _error = INVALID_TABLE;
+            return false;
+        }
+    }
+
+    _playTable = intervals;
+    _playLength = length;
+    _playRepeats = repeats;
+    _playDone = false;
+    _pulseMode = PLAYBACK;
+    _requestedFrequency = 0;              // The spacing comes from the table, so there is nothing to compare against.
+    _dithering = false;
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    // Entry 0 is played as a silent period. The callback at its end starts the period after the next,
+    // so the first pulse is buffered straight after starting.
+    uint16_t first = readInterval(intervals);
+    uint32_t frequency = (R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_PCLKD) >> sourceDiv) / first;
+    if (!_openTimer(frequency ? frequency : 1, PLAYBACK, sourceDiv)) {
+        return false;
+    }
+    _playIndex = 1;
+    _pulseCounter = 1;
+    _timer.set_period(first);
+    _setDuty(0);
+    _timer.start();
+    _isRunning = true;
+    _loadPlaybackPeriod();
+#else
+    // The vector loads each following entry as its edge passes, and calls back at the end of the pass.
+    timing.top = readInterval(intervals) - 1;
+    ptoPlayNext[_timerId] = intervals + 1;
+    ptoPlayEnd[_timerId] = intervals + length;
+    ptoFinish[_timerId] = (repeats == 1);
+    _startTimer(timing, true);
+#endif
+    return true;
+}
+
+bool pulseTrainOutput::isPlaybackDone() const {
+    return _playDone;
+}
+
+bool pulseTrainOutput::_nextPlaybackPass() {
+    if (_playRepeats == 1) {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+        _playDone = true;
+        _finish();                        // The last entry's edge has just cleared the pin.
+#endif
+        return false;
+    }
+    if (_playRepeats != 0) {
+        _playRepeats--;
+    }
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    // The counter has only just cleared, so entry 0 times the interval that starts with this edge.
+    _writeOcr(readInterval(_playTable) - 1);
+    ptoPlayNext[_timerId] = _playTable + 1;
+    ptoPlayEnd[_timerId] = _playTable + _playLength;
+    ptoFinish[_timerId] = (_playRepeats == 1);
+#else
+    _playIndex = 0;
+#endif
+    return true;
+}
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+bool pulseTrainOutput::_playFetch(uint16_t& value) {
+    if (_playIndex == _playLength && !_nextPlaybackPass()) {
+        return false;
+    }
+    value = readInterval(&_playTable[_playIndex++]);
+    return true;
+}
+
+void pulseTrainOutput::_loadPlaybackPeriod() {
+    uint16_t high;
+    uint16_t low;
+    if (!_playFetch(high)) {
+        _setDuty(0);   // Hold the pin LOW until the callback stops the timer.
+        _pulseCounter = 0;
+        return;
+    }
+    if (!_playFetch(low)) {
+        low = high;                       // The last pulse: its LOW half only has to last until the stop.
+    }
+    _timer.set_period((uint32_t)high + low);
+    _setDuty(high);
+}
+#endif
+
+bool pulseTrainOutput::burst(uint32_t frequency, uint32_t pulses, uint32_t periodMicros, uint32_t bursts) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    if (pulses == 0) {
+        _error = ZERO_PULSES;
+        return false;
+    }
+    _dithering = false;
+    _pulseMode = BURST;
+    _requestedFrequency = frequency;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (!_openTimer(frequency, BURST)) {  // Enables the overflow callback, which does the gating.
+        return false;
+    }
+    uint32_t top = _timer.get_period_raw();
+    uint32_t maxCounts = (!_is_agt && _timer_channel < 2) ? 0xFFFFFFFFUL : 0x10000UL;
+    uint64_t periodCounts = (uint64_t)periodMicros * r4TimerClock(_timer, _is_agt) / 1000000UL;
+    // The callback that ends the last pulse buffers the gap, so one more pulse period passes first.
+    uint64_t burstCounts = (uint64_t)(pulses + 1ULL) * top;
+#else
+    pulseTiming timing;
+    if (!_calculateTimingParameters(frequency, timing) || timing.postscale > 1) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    // The gap is counted at the pulses' prescaler, so take the largest one that still times both the
+    // half period and the burst period exactly. Fewer counts means fewer interrupts in the gap.
+    const uint8_t* shifts = _is16bit ? timer16Shift : timer8Shift;
+    uint8_t maxBits = _is16bit ? 5 : 7;
+    uint32_t maxCounts = _is16bit ? 0x10000UL : 0x100UL;
+    uint32_t halfCycles = (timing.top + 1) << shifts[timing.prescalerBits];
+    uint64_t periodCycles = (uint64_t)periodMicros * (F_CPU / 1000000UL);
+    for (uint8_t bits = maxBits; bits > timing.prescalerBits; bits--) {
+        uint32_t mask = (1UL << shifts[bits]) - 1;
+        if ((halfCycles & mask) == 0 && (periodCycles & mask) == 0 && (halfCycles >> shifts[bits]) <= maxCounts) {
+            timing.top = (halfCycles >> shifts[bits]) - 1;
+            timing.prescalerBits = bits;
+            break;
+        }
+    }
+    uint32_t top = timing.top;
+    uint64_t periodCounts = periodCycles >> shifts[timing.prescalerBits];
+    // The period runs from one burst's first rising edge to the next, which leaves out its first LOW half.
+    uint64_t burstCounts = (2ULL * pulses - 1) * (top + 1);
+#endif
+    if (periodCounts <= burstCounts || periodCounts - burstCounts < top + 1) {
+        _error = INVALID_BURST;           // The gap has to be at least a half period (AVR) or a period (R4).
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+        _timer.end();
+#endif
+        return false;
+    }
+    uint64_t gap = periodCounts - burstCounts;
+    uint64_t chunks = (gap + maxCounts - 1) / maxCounts;
+    _burstGapChunks = chunks;
+    _burstGapBase = gap / chunks;
+    _burstGapExtra = gap % chunks;
+    _burstGapLeft = 0;
+    _burstTop = top;
+    _burstPulses = pulses;
+    _burstsLeft = bursts;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    _pulsesToGenerate = pulses;
+    _pulseCounter = pulses;
+    _timer.start();
+    _isRunning = true;
+#else
+    _hardwareCounting = false;
+    _updatePending = false;
+    _pulsesToGenerate = pulses * 2;
+    _pulseCounter = _pulsesToGenerate;
+    _delegateCount();                     // The timer is stopped and its interrupt off, so this is safe here.
+    _startTimer(timing, true);
+#endif
+    return true;
+}
+
+bool pulseTrainOutput::_startBurstGap() {
+    if (_burstsLeft == 1) {
+        return false;
+    }
+    if (_burstsLeft != 0) {
+        _burstsLeft--;
+    }
+    _foldPosition();
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    _burstGapLeft = _burstGapChunks + 1;  // Counts the callback that starts the next burst, too.
+#else
+    _burstGapLeft = _burstGapChunks;
+#endif
+    _loadBurstChunk(0);
+    return true;
+}
+
+void pulseTrainOutput::_advanceBurstGap() {
+    uint32_t left = --_burstGapLeft;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (left == 0) {
+        // The next burst's first pulse has started, which is where start() leaves the first burst.
+        _pulsesToGenerate = _burstPulses;
+        _pulseCounter = _burstPulses;
+    } else if (left == 1) {
+        // The last piece of the gap has started. Buffered, so the pulses come straight after it.
+        _timer.set_period(_burstTop);
+        _setDuty(_burstTop / 2);
+    } else {
+        _loadBurstChunk(_burstGapChunks + 1 - left);
+    }
+#else
+    if (left == 0) {
+        // That match was the rising edge of the next burst's first pulse. Back to the pulse timing,
+        // and count the edge, as the fast path would have.
+        _writeOcr(_burstTop);
+        _pulsesToGenerate = _burstPulses * 2;
+        _pulseCounter = _pulsesToGenerate - 1;
+        if (_pulseCounter == 1) {
+            *_tccrA = (*_tccrA & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A1);   // A single pulse: its fall ends the burst.
+        } else {
+            _delegateCount();
+        }
     } else {
-        ocrValue = (F_CPU / (2UL * frequency)) - 1; prescalerBits = _BV(CS20);
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 8 * frequency)) - 1; prescalerBits = _BV(CS21); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 32 * frequency)) - 1; prescalerBits = _BV(CS21) | _BV(CS20); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 64 * frequency)) - 1; prescalerBits = _BV(CS22); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 128 * frequency)) - 1; prescalerBits = _BV(CS22) | _BV(CS20); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 256 * frequency)) - 1; prescalerBits = _BV(CS22) | _BV(CS21); }
-        if (ocrValue > maxOcr) { ocrValue = (F_CPU / (2UL * 1024 * frequency)) - 1; prescalerBits = _BV(CS22) | _BV(CS21) | _BV(CS20); }
-    }
-    if (ocrValue > maxOcr) {
+        _loadBurstChunk(_burstGapChunks - left);
+    }
+#endif
+}
+
+void pulseTrainOutput::_loadBurstChunk(uint32_t index) {
+    uint32_t counts = _burstGapBase + (index < _burstGapExtra);
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    // Buffered, so this is the period after the one that has just started. A duty of 0 keeps it silent.
+    _timer.set_period(counts);
+    _setDuty(0);
+#else
+    // The counter has only just cleared, so this times the interval that started with this match. The
+    // output is still on "Clear" from the last pulse, which holds it LOW, until the last piece toggles it HIGH.
+    _writeOcr(counts - 1);
+    if (index + 1 == _burstGapChunks) {
+        *_tccrA = (*_tccrA & ~(_BV(COM1A1) | _BV(COM1A0))) | _BV(COM1A0);
+    }
+#endif
+}
+
+bool pulseTrainOutput::generateWidth(uint32_t frequency, uint32_t widthNanos, pulseModes mode, uint32_t pulses) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    if (mode != DISCRETE && mode != CONTINUOUS) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    if (pulses == 0 && mode == DISCRETE) {
+        _error = ZERO_PULSES;
+        return false;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (_is_agt) {
+        _error = INVALID_MODE;
+        return false;
+    }
+#else
+    if (!_is16bit) {
+        _error = INVALID_MODE;            // Timer2's only TOP register is OCR2A, the output's own compare.
+        return false;
+    }
+#endif
+    _dithering = false;
+    _pulseMode = WIDTH;
+    _pulsesToGenerate = (mode == DISCRETE) ? pulses : 0;
+    _pulseCounter = _pulsesToGenerate;
+    _requestedFrequency = frequency;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (!_openTimer(frequency, WIDTH)) {  // Enables the overflow callback for a DISCRETE train only.
+        return false;
+    }
+    uint32_t period = _timer.get_period_raw();
+    uint32_t width = nanosToCounts(widthNanos, r4TimerClock(_timer, _is_agt));
+    if (width == 0 || width >= period) {
+        _error = INVALID_WIDTH;
+        _timer.end();
+        return false;
+    }
+    // Each GPT period starts HIGH, so the pulse comes first and the callback counts it as the period ends.
+    _setDuty(width);
+    _timer.start();
+    _isRunning = true;
+#else
+    // The period is solved whole rather than as two halves, at the prescaler that comes closest.
+    uint32_t period = 0;
+    uint64_t bestError = 0;
+    uint8_t bits = 0;
+    for (uint8_t candidate = 1; candidate <= 5; candidate++) {
+        uint64_t error;
+        uint32_t counts = nearestCounts(F_CPU >> timer16Shift[candidate], frequency, 0x10000UL, error);
+        if (counts && (period == 0 || error * period < bestError * counts)) {
+            period = counts;
+            bestError = error;
+            bits = candidate;
+        }
+    }
+    if (period == 0) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    uint32_t width = nanosToCounts(widthNanos, avrTimerClock(true, bits));
+    if (width == 0 || width >= period) {
+        _error = INVALID_WIDTH;
+        return false;
+    }
+    _hardwareCounting = false;
+    _updatePending = false;
+    _widthTopPending = false;
+    _postscale = 1;
+    _postscaleLeft = 1;
+    uint8_t oldSREG = SREG;
+    cli();
+    // OCRnA is only buffered in the PWM modes, so load the first compare while the timer is in normal mode.
+    *_tccrA = 0;
+    *_tccrB = 0;
+    *_icr = period - 1;
+    _writeOcr(period - 1 - width);
+    _writeCounter(0);
+    // Fast PWM with ICRn as TOP (mode 14), inverting: the pin clears at BOTTOM and sets at the compare,
+    // so each period is LOW first and ends with its pulse. The overflow flags at TOP, a count before
+    // the falling edge at BOTTOM.
+    *_tccrA = _BV(COM1A1) | _BV(COM1A0) | _BV(WGM11);
+    *_tccrB = _BV(WGM13) | _BV(WGM12);
+    if (_pulseCounter == 1) {
+        _writeOcr(0xFFFF);                // Buffered: above TOP, so the period after the only pulse stays LOW.
+    }
+    if (_pulsesToGenerate != 0) {
+        *_tifr = _BV(TOV1);
+        PTO_MODEL_WRITE(_tifr);
+        *_timsk |= _BV(TOIE1);
+    }
+    _isRunning = true;
+    _setClock(bits);
+    SREG = oldSREG;
+#endif
+    return true;
+}
+
+bool pulseTrainOutput::updateWidth(uint32_t frequency, uint32_t widthNanos) {
+    if (!_isRunning || _pulseMode != WIDTH) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    pulseTiming timing;
+    if (!_calculateTimingParameters(frequency, timing)) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    uint32_t clock = r4TimerClock(_timer, _is_agt);
+    uint32_t width = nanosToCounts(widthNanos, clock);
+    if (width == 0 || width >= timing.top) {
+        _error = INVALID_WIDTH;
+        return false;
+    }
+    // The period and duty buffers transfer at the same overflow, but they're written one after the
+    // other. Within 10us of the end of the period, wait for the overflow so both land on the next one.
+    R_GPT0_Type* gpt = gptRegisters(_timer_channel);
+    uint32_t margin = clock / 100000UL + 2;
+    noInterrupts();
+    uint32_t count = gpt->GTCNT;
+    if (gpt->GTPR - count < margin) {
+        for (uint32_t now = count; now >= count; now = gpt->GTCNT) {
+            count = now;
+        }
+    }
+    bool success = _timer.set_period(timing.top) && _setDuty(width);
+    interrupts();
+    _requestedFrequency = success ? frequency : 0;
+    return success;
+#else
+    uint8_t bits = *_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10));
+    uint32_t clock = avrTimerClock(true, bits);
+    uint64_t error;
+    uint32_t period = nearestCounts(clock, frequency, 0x10000UL, error);
+    if (period == 0) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    uint32_t width = nanosToCounts(widthNanos, clock);
+    if (width == 0 || width >= period) {
+        _error = INVALID_WIDTH;
+        return false;
+    }
+    uint8_t oldSREG = SREG;
+    cli();
+    _widthStagedTop = period - 1;
+    _widthStagedCompare = period - 1 - width;
+    _updatePending = true;
+    if (!(*_timsk & _BV(TOIE1))) {
+        // A CONTINUOUS train runs without the interrupt, so enable it just for the commit.
+        *_tifr = _BV(TOV1);
+        PTO_MODEL_WRITE(_tifr);
+        *_timsk |= _BV(TOIE1);
+    }
+    _requestedFrequency = frequency;
+    SREG = oldSREG;
+    return true;
+#endif
+}
+
+void pulseTrainOutput::handleOverflowInterrupt() {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    if (_pulseMode != WIDTH) {
+        return;
+    }
+    // TOVn sets at TOP, but the pulse falls and OCRnA's buffer loads a count later, at BOTTOM. At /64
+    // and slower the interrupt gets here first, so wait for BOTTOM. Until then a buffered compare
+    // would load into the period now ending, and _finish() would cut the last pulse short.
+    uint16_t top = *_icr;
+    while (_readCounter() == top) {
+    }
+    // A period has just ended, and the pulse with it.
+    if (_widthTopPending) {
+        // The compare buffered at the last overflow has just been loaded, so its TOP goes in now. ICRn
+        // isn't buffered: a count already past it would run on to 0xFFFF, so end the period instead.
+        _widthTopPending = false;
+        *_icr = _widthNextTop;
+        if (_readCounter() >= _widthNextTop) {
+            _writeCounter(_widthNextTop);
+        }
+    }
+    if (_pulsesToGenerate != 0) {
+        if (--_pulseCounter == 0) {
+            _finish();
+            return;
+        }
+        if (_pulseCounter == 1) {
+            // Buffered, so the period after the last pulse stays LOW however late the overflow that ends it is.
+            _writeOcr(0xFFFF);
+            return;
+        }
+    }
+    if (_updatePending) {
+        // Buffered, so the compare starts with the next period, and the overflow that starts it writes TOP.
+        _updatePending = false;
+        _writeOcr(_widthStagedCompare);
+        _widthNextTop = _widthStagedTop;
+        _widthTopPending = true;
+    } else if (_pulsesToGenerate == 0 && !_widthTopPending) {
+        *_timsk &= ~_BV(TOIE1);           // The interrupt was only enabled to commit an update.
+    }
+#endif
+}
+
+bool pulseTrainOutput::stream(uint32_t periods[], uint32_t highs[], uint16_t length, uint16_t divider, streamRefill refill) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (_is_agt) {
+        _error = INVALID_MODE;            // The DTC writes the GPT's buffer registers, which the AGT doesn't have.
+        return false;
+    }
+    if (periods == nullptr || highs == nullptr || length < 8 || (length & 1)) {
+        _error = INVALID_STREAM;
+        return false;
+    }
+    int8_t sourceDiv = -1;
+    for (uint8_t div = 0; div <= 10; div += 2) {
+        if (divider == (1U << div)) {
+            sourceDiv = div;
+        }
+    }
+    if (sourceDiv < 0) {
+        _error = INVALID_STREAM;
+        return false;
+    }
+    // The first ring is checked here. Refilled entries are the caller's to get right, as the DTC can't check.
+    uint32_t maxCounts = (_timer_channel < 2) ? 0xFFFFFFFFUL : 0x10000UL;
+    for (uint16_t i = 0; i < length; i++) {
+        if (periods[i] < 2 || periods[i] > maxCounts || highs[i] == 0 || highs[i] >= periods[i]) {
+            _error = INVALID_STREAM;
+            return false;
+        }
+    }
+
+    _pulseMode = STREAM;
+    _requestedFrequency = 0;              // The spacing comes from the ring, so there is nothing to compare against.
+    _dithering = false;
+    uint32_t frequency = (R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_PCLKD) >> sourceDiv) / periods[0];
+    if (!_openTimer(frequency ? frequency : 1, STREAM, sourceDiv)) {
+        return false;
+    }
+    for (uint16_t i = 0; i < length; i++) {
+        periods[i]--;                     // GTPR and GTPBR hold one less than the period.
+    }
+    // The first pulse goes straight into the registers and the second into their buffers, so the DTC
+    // starts at entry 2 with the first overflow. GTCCR[] is in the FSP's order: A, B, C, E, D, F.
+    R_GPT0_Type* gpt = gptRegisters(_timer_channel);
+    uint8_t compare = (_pwm_channel == CHANNEL_A) ? 0 : 1;     // GTCCRA or GTCCRB.
+    uint8_t buffer = (_pwm_channel == CHANNEL_A) ? 2 : 3;      // GTCCRC or GTCCRE.
+    gpt->GTPR = periods[0];
+    gpt->GTCCR[compare] = highs[0];
+    gpt->GTPBR = periods[1];
+    gpt->GTCCR[buffer] = highs[1];
+
+    _streamPeriods = periods;
+    _streamHighs = highs;
+    _streamHalf = length / 2;
+    _streamCounts[0] = _streamHalf;
+    _streamCounts[1] = _streamHalf;
+    _streamPass = 0;
+    _streamRefill = refill;
+    for (uint8_t i = 0; i < 2; i++) {
+        // One word from each ring per overflow. The period chains straight on to its HIGH time, and the
+        // CPU only gets the overflow once a pass is done.
+        _dtcInfo[i].transfer_settings_word = 0;
+        _dtcInfo[i].transfer_settings_word_b.mode = TRANSFER_MODE_NORMAL;
+        _dtcInfo[i].transfer_settings_word_b.size = TRANSFER_SIZE_4_BYTE;
+        _dtcInfo[i].transfer_settings_word_b.src_addr_mode = TRANSFER_ADDR_MODE_INCREMENTED;
+        _dtcInfo[i].transfer_settings_word_b.dest_addr_mode = TRANSFER_ADDR_MODE_FIXED;
+        _dtcInfo[i].transfer_settings_word_b.irq = TRANSFER_IRQ_END;
+        _dtcInfo[i].transfer_settings_word_b.chain_mode = (i == 0) ? TRANSFER_CHAIN_MODE_EACH : TRANSFER_CHAIN_MODE_DISABLED;
+        _dtcInfo[i].num_blocks = 0;
+        _dtcInfo[i].length = _streamHalf - 2;
+    }
+    _dtcInfo[0].p_src = &periods[2];
+    _dtcInfo[0].p_dest = (void*)&gpt->GTPBR;
+    _dtcInfo[1].p_src = &highs[2];
+    _dtcInfo[1].p_dest = (void*)&gpt->GTCCR[buffer];
+    _dtcExtend.activation_source = _timer.get_cfg()->cycle_end_irq;
+    _dtcCfg.p_info = _dtcInfo;
+    _dtcCfg.p_extend = &_dtcExtend;
+    if (R_DTC_Open(&_dtcCtrl, &_dtcCfg) != FSP_SUCCESS) {
+        _error = TIMER_OPEN_FAILED;
+        _timer.end();
+        return false;
+    }
+    _dtcOpen = true;
+    if (R_DTC_Enable(&_dtcCtrl) != FSP_SUCCESS) {
+        stop();
+        _error = TIMER_OPEN_FAILED;
+        return false;
+    }
+    _pulsesToGenerate = _streamHalf;      // The two written above and the first pass.
+    _pulseCounter = 0;
+    _streamArmed = true;
+    _timer.start();
+    _isRunning = true;
+    return true;
+#else
+    (void)periods;
+    (void)highs;
+    (void)length;
+    (void)divider;
+    (void)refill;
+    _error = INVALID_MODE;                // The AVR boards have no DTC. play() streams a table from flash instead.
+    return false;
+#endif
+}
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+void pulseTrainOutput::_advanceStream() {
+    // The DTC has just buffered the last entry of its pass, and turned its trigger off so this overflow
+    // reached the CPU. The next overflow is a whole period away.
+    uint8_t played = _streamPass;
+    uint8_t next = played ^ 1;
+    uint16_t count = _streamCounts[next];
+    if (count == 0) {
+        // The pulse playing and the one buffered are the last. The callback counts them out as DISCRETE.
+        _streamArmed = false;
+        _pulseCounter = 2;
+        return;
+    }
+    uint16_t first = next * _streamHalf;
+    _pulsesToGenerate += count;
+    _dtcInfo[0].p_src = &_streamPeriods[first];
+    _dtcInfo[0].length = count;
+    _dtcInfo[1].p_src = &_streamHighs[first];
+    _dtcInfo[1].length = count;
+    R_DTC_Reconfigure(&_dtcCtrl, _dtcInfo);   // Turns the trigger back on.
+    _streamPass = next;
+
+    // The half just played is free, and has a whole pass to be refilled in.
+    uint16_t start = played * _streamHalf;
+    uint16_t written = 0;
+    if (_streamRefill != nullptr) {
+        written = _streamRefill(*this, &_streamPeriods[start], &_streamHighs[start], _streamHalf);
+        if (written > _streamHalf) {
+            written = _streamHalf;
+        }
+        for (uint16_t i = 0; i < written; i++) {
+            _streamPeriods[start + i]--;
+        }
+        if (written < _streamHalf) {
+            _streamRefill = nullptr;      // The train ends with these.
+        }
+    }
+    _streamCounts[played] = written;
+}
+#endif
+
+bool pulseTrainOutput::track(uint32_t frequency, uint32_t maxStepHz, uint32_t deadbandHz) {
+    if (_isRunning) {
+        _error = ACTIVE;
+        return false;
+    }
+    if (_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    _targetSlots[0] = frequency;
+    _targetSlots[1] = frequency;
+    _targetSeen = _targetSeq;
+    _trackTarget = frequency;
+    _trackFrequency = frequency;
+    _trackStep = maxStepHz;
+    _trackDeadband = deadbandHz;
+    _dithering = false;
+    _pulseMode = TRACKING;
+    _requestedFrequency = frequency;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (!_openTimer(frequency, TRACKING)) {   // Enables the overflow callback, which does the tracking.
+        return false;
+    }
+    _trackTiming.top = _timer.get_period_raw();
+    _trackTiming.prescalerBits = 0;
+    _trackTiming.postscale = 1;
+    _timer.start();
+    _isRunning = true;
+#else
+    pulseTiming timing;
+    if (!_calculateTimingParameters(frequency, timing)) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    _trackTiming = timing;
+    _hardwareCounting = false;
+    _updatePending = false;
+    _startTimer(timing, timing.postscale > 1);    // Otherwise the interrupt only runs while there's a target to reach.
+#endif
+    return true;
+}
+
+void pulseTrainOutput::setTarget(uint32_t frequency) {
+    uint8_t seq = _targetSeq + 1;
+    _targetSlots[seq & 1] = frequency;
+    _targetSeq = seq;
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    if (_pulseMode == TRACKING && _isRunning && !(*_timsk & (1 << _ocieBit))) {
+        // The interrupt only ever turns itself off, and it will have seen the target if it did so
+        // after the store above. A stale flag is discarded so the commit waits for a real boundary.
+        uint8_t oldSREG = SREG;
+        cli();
+        *_tifr = (1 << _ocieBit);
+        PTO_MODEL_WRITE(_tifr);
+        *_timsk |= (1 << _ocieBit);
+        SREG = oldSREG;
+    }
+#endif
+}
+
+bool pulseTrainOutput::_advanceTracking() {
+    uint32_t current = _trackFrequency;
+    uint8_t seq = _targetSeq;
+    if (seq != _targetSeen) {
+        _targetSeen = seq;
+        uint32_t posted = _targetSlots[seq & 1];
+        uint32_t change = posted > current ? posted - current : current - posted;
+        if (posted != 0 && change > _trackDeadband) {
+            _trackTarget = posted;
+        }
+    }
+    uint32_t target = _trackTarget;
+    if (target == current) {
+        return false;
+    }
+    uint32_t next = target;
+    uint32_t step = _trackStep;
+    if (step != 0) {
+        if (target > current && target - current > step) {
+            next = current + step;
+        } else if (target < current && current - target > step) {
+            next = current - step;
+        }
+    }
+    pulseTiming timing;
+    if (!_calculateTimingParameters(next, timing)) {
+        _trackTarget = current;           // Out of range: hold where we are.
+        return false;
+    }
+    _trackFrequency = next;
+    _requestedFrequency = next;
+    if (timing.top != _trackTiming.top || timing.prescalerBits != _trackTiming.prescalerBits ||
+        timing.postscale != _trackTiming.postscale) {
+        _trackTiming = timing;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+        _timer.set_period(timing.top);
+        _setDuty(timing.top / 2);
+#else
+        _applyTiming(timing);
+        _setPostscale(timing.postscale, true);
+#endif
+    }
+    return next != target;
+}
+
+bool pulseTrainOutput::generateMilliHz(uint64_t milliHertz, pulseModes mode, uint32_t pulses, bool dither) {
+    if (milliHertz == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    if (milliHertz > 0xFFFFFFFFULL * 1000) {
+        _error = FREQUENCY_HIGH;
+        return false;
+    }
+    // Validate and open the timer at the nearest whole frequency, then refine the count below.
+    uint32_t nearest = (milliHertz + 500) / 1000;
+    pulseTiming timing;
+    int8_t sourceDiv = -1;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (!_is_agt && _timerId != TID_INVALID) {
+        // Fix the finest divider whose period fits. Going by the nearest whole frequency can't reach
+        // the slowest periods, which GPT0 and GPT1 stretch to hours with their 32-bit counters.
+        uint32_t maxCounts = (_timer_channel < 2) ? 0xFFFFFFFFUL : 0x10000UL;
+        uint64_t clock = (uint64_t)R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_PCLKD) * 1000;
+        for (int8_t div = 10; div >= 0; div -= 2) {
+            if ((clock >> div) / milliHertz < maxCounts) {
+                sourceDiv = div;
+            }
+        }
+    }
+#endif
+    _dithering = dither;                  // The R4 needs the overflow interrupt opened for dithering.
+    if (!_prepareGenerate(nearest ? nearest : 1, mode, pulses, timing, sourceDiv)) {
+        _dithering = false;
+        return false;
+    }
+    uint32_t fraction;
+    if (!_solveMilliHz(milliHertz, timing, fraction)) {
         _error = FREQUENCY_HIGH;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+        _timer.end();
+#endif
+        _dithering = false;
+        return false;
+    }
+    if (!_dithering) {
+        timing.top += (fraction >> 31);   // Round to the nearest count.
+        fraction = 0;
+    }
+    _ditherTop = timing.top;
+    _ditherStep = fraction;
+    _ditherAccumulator = 0x80000000UL;    // Half way, so the first long interval falls mid-cycle.
+    _dithering = (fraction != 0);
+    _requestedFrequency = milliHertz / 1000.0f;
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    _timer.set_period(timing.top);
+    _setDuty(timing.top / 2);
+    _timer.start();
+    _isRunning = true;
+#else
+    _launch(timing, pulses);
+#endif
+    return true;
+}
+
+// The fractional part of remainder / divisor in 1/2^32 units, by two rounds of 16-bit long division.
+// remainder < divisor < 2^48, so neither shift can overflow.
+static uint32_t fraction32(uint64_t remainder, uint64_t divisor) {
+    remainder <<= 16;
+    uint32_t high = remainder / divisor;
+    remainder = (remainder % divisor) << 16;
+    return (high << 16) | (uint32_t)(remainder / divisor);
+}
+
+bool pulseTrainOutput::_solveMilliHz(uint64_t milliHertz, pulseTiming& timing, uint32_t& fraction) {
+    uint64_t numerator;                   // The timer clock in millihertz.
+    uint64_t intervals;                   // Interrupt intervals per second, in millihertz.
+    uint64_t counts;
+    uint32_t clock;
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint32_t maxCounts = (!_is_agt && _timer_channel < 2) ? 0xFFFFFFFFUL : 0x10000UL;
+    clock = r4TimerClock(_timer, _is_agt);
+    numerator = (uint64_t)clock * 1000;
+    intervals = milliHertz;               // One overflow per pulse.
+    counts = numerator / intervals;
+    if (counts < 2 || counts >= maxCounts) {
+        return false;
+    }
+    timing.top = counts;                  // The period in counts.
+    timing.prescalerBits = 0;
+    timing.postscale = 1;
+#else
+    // The smallest prescaler that fits gives the finest steps.
+    const uint8_t* shifts = _is16bit ? timer16Shift : timer8Shift;
+    uint8_t maxBits = _is16bit ? 5 : 7;
+    uint32_t maxCounts = _is16bit ? 0x10000UL : 0x100UL;
+    numerator = (uint64_t)F_CPU * 1000;
+    uint8_t bits = 1;
+    do {
+        intervals = (milliHertz * 2) << shifts[bits];   // Two toggles per pulse, each of 'divider' CPU cycles per count.
+        counts = numerator / intervals;
+        if (counts < maxCounts) {
+            break;
+        }
+    } while (++bits <= maxBits);
+    uint32_t postscale = 1;
+    if (bits > maxBits) {
+        // Below the timer's range: postscale as _calculateTimingParameters() does.
+        bits = maxBits;
+        postscale = counts / maxCounts + 1;
+        if (postscale > 0xFFFF) {
+            return false;
+        }
+        intervals *= postscale;
+        counts = numerator / intervals;
+    }
+    if (counts == 0) {
+        return false;
+    }
+    clock = F_CPU >> shifts[bits];
+    timing.top = counts - 1;              // OCR counts from zero.
+    timing.prescalerBits = bits;
+    timing.postscale = postscale;
+#endif
+    fraction = fraction32(numerator - counts * intervals, intervals);
+    if ((uint64_t)counts * 1000000UL < (uint64_t)clock * PTO_DITHER_MIN_INTERVAL_US) {
+        _dithering = false;               // Too fast for the interrupt to reload every interval.
+    }
+    return true;
+}
+
+uint32_t pulseTrainOutput::_advanceRamp() {
+    uint32_t interval = _pulsesToGenerate - _pulseCounter;
+    while (_rampPhase < 6 && interval >= _rampBoundary[_rampPhase]) {
+        _rampPhase++;
+        // Each phase starts from its exact acceleration, so rounding never carries across phases.
+        _rampAccel = (_rampPhase == 4) ? 0 : _rampAccelPeak;
+    }
+    switch (_rampPhase) {
+        case 0: case 4: {                     // Acceleration building up.
+            uint32_t jerk = (_rampPhase == 0) ? _rampJerkUp : _rampJerkDown;
+            _rampAccel = (_rampAccelPeak - _rampAccel > jerk) ? _rampAccel + jerk : _rampAccelPeak;
+            break;
+        }
+        case 2: case 6: {                     // Acceleration easing off.
+            uint32_t jerk = (_rampPhase == 2) ? _rampJerkDown : _rampJerkUp;
+            _rampAccel = (_rampAccel > jerk) ? _rampAccel - jerk : 0;
+            break;
+        }
+    }
+    if (_rampPhase != 3 && _rampAccel != 0) {
+        // x = a * T^2 / F^2 is the fractional speed change over this interval (0.32 fixed point).
+        // The exact update is T / (1 +- x), so apply T * (x - x^2) when accelerating and T * (x + x^2)
+        // when decelerating. The second-order term keeps the two ramps symmetric.
+        uint16_t ticks = _rampPeriod >> 16;
+        uint32_t product = ((uint64_t)((uint32_t)ticks * ticks) * _rampAccel) >> 32;
+        uint32_t fraction;
+        if (_rampShift >= 32) {
+            fraction = product >> (_rampShift - 32);
+        } else if (product >> _rampShift) {
+            fraction = 0xFFFFFFFFUL;          // A whole interval's worth of change or more: saturate.
+        } else {
+            fraction = product << (32 - _rampShift);
+        }
+        uint32_t delta = ((uint64_t)_rampPeriod * fraction) >> 32;
+        uint32_t second = ((uint64_t)delta * fraction) >> 32;
+        if (_rampPhase < 3) {
+            delta -= second;
+            _rampPeriod = (delta < _rampPeriod - _rampPeriodMin) ? _rampPeriod - delta : _rampPeriodMin;
+        } else {
+            delta += second;
+            _rampPeriod = (delta < _rampPeriodMax - _rampPeriod) ? _rampPeriod + delta : _rampPeriodMax;
+        }
+    }
+    return ((_rampPeriod + 0x8000UL) >> 16) << _rampScale;
+}
+
+
+// --- Synchronized Group ---
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+// clk/1 bypasses the prescaler, so GTCCR's TSM can't hold a timer running on it. A member's timing
+// that came out at /1 is solved again from /8.
+static bool holdableTiming(bool is16bit, uint32_t frequency, pulseTiming& timing) {
+    if (timing.prescalerBits != 1) {
+        return true;
+    }
+    return avrSolveTiming(is16bit, frequency, timing, 2);
+}
+#endif
+
+pulseTrainGroup::pulseTrainGroup() {
+    _count = 0;
+    _error = NO_ERROR;
+    for (uint8_t i = 0; i < PTO_GROUP_SIZE; i++) {
+        _members[i] = nullptr;
+        _skew[i] = 0;
+    }
+}
+
+bool pulseTrainGroup::add(pulseTrainOutput& output) {
+    if (_count >= PTO_GROUP_SIZE) {
+        _error = GROUP_FULL;
+        return false;
+    }
+    if (output._timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    if (output._is_agt) {
+        _error = INVALID_MODE;            // AGT channels have no shared start register.
+        return false;
+    }
+#endif
+    _members[_count++] = &output;
+    return true;
+}
+
+bool pulseTrainGroup::generate(uint32_t frequency, pulseModes mode, uint32_t pulses) {
+    uint32_t frequencies[PTO_GROUP_SIZE];
+    for (uint8_t i = 0; i < PTO_GROUP_SIZE; i++) {
+        frequencies[i] = frequency;
+    }
+    return generate(frequencies, mode, pulses);
+}
+
+bool pulseTrainGroup::generate(const uint32_t frequencies[], pulseModes mode, uint32_t pulses) {
+    pulseTiming timing[PTO_GROUP_SIZE];
+    for (uint8_t i = 0; i < _count; i++) {
+        if (!_members[i]->_prepareGenerate(frequencies[i], mode, pulses, timing[i])) {
+            _error = _members[i]->_error;
+            for (uint8_t j = 0; j < i; j++) {
+                _members[j]->stop();      // Releases anything the earlier members opened.
+            }
+            return false;
+        }
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+        if (!holdableTiming(_members[i]->_is16bit, frequencies[i], timing[i])) {
+            _error = FREQUENCY_HIGH;      // Nothing is opened on AVR until the launch, so there's nothing to release.
+            return false;
+        }
+#endif
+    }
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        _members[i]->_timer.reset();
+        mask |= 1UL << _members[i]->_timer_channel;
+    }
+    noInterrupts();
+    gptRegisters(0)->GTSTR = mask;
+    for (uint8_t i = 0; i < _count; i++) {
+        _members[i]->_isRunning = true;
+    }
+    _measureSkew();
+    interrupts();
+#else
+    uint8_t oldSREG = SREG;
+    cli();
+    GTCCR = _BV(TSM) | _BV(PSRASY) | _BV(PSRSYNC);   // Hold every prescaler, and so every timer, in reset.
+    for (uint8_t i = 0; i < _count; i++) {
+        _members[i]->_launch(timing[i], pulses);
+    }
+    GTCCR = 0;                                       // Release them on the same clock.
+    _measureSkew();
+    SREG = oldSREG;
+#endif
+    _error = NO_ERROR;
+    return true;
+}
+
+bool pulseTrainGroup::updateFrequency(const uint32_t frequencies[]) {
+    pulseTiming timing[PTO_GROUP_SIZE];
+    for (uint8_t i = 0; i < _count; i++) {
+        pulseTrainOutput* member = _members[i];
+        if (!member->_isRunning) {
+            _error = ACTIVE;
+            return false;
+        }
+        if (!member->calculateTiming(frequencies[i], timing[i])) {
+            _error = member->_error;
+            return false;
+        }
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+        if (timing[i].postscale > 1 || member->_postscale > 1) {
+            _error = FREQUENCY_HIGH;      // The registers are written directly below, with no interrupt to follow the postscale.
+            return false;
+        }
+        if (!holdableTiming(member->_is16bit, frequencies[i], timing[i])) {
+            _error = FREQUENCY_HIGH;
+            return false;
+        }
+#endif
+    }
+
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        mask |= 1UL << _members[i]->_timer_channel;
+    }
+    noInterrupts();
+    gptRegisters(0)->GTSTP = mask;
+    for (uint8_t i = 0; i < _count; i++) {
+        _members[i]->updateFrequency(timing[i]);
+    }
+    gptRegisters(0)->GTSTR = mask;
+    interrupts();
+#else
+    uint8_t oldSREG = SREG;
+    cli();
+    GTCCR = _BV(TSM) | _BV(PSRASY) | _BV(PSRSYNC);
+    for (uint8_t i = 0; i < _count; i++) {
+        pulseTrainOutput* member = _members[i];
+        uint16_t top = timing[i].top;
+        uint16_t count = member->_readCounter();
+        uint16_t firstCount = count;
+        if (count > top) {
+            // Pull the count back below the top as _applyTiming() does, so the half period ends on the
+            // next count instead of after a wrap. Writing TCNT blocks a match on the count written.
+            uint16_t written = top ? top - 1 : 0;
+            member->_writeCounter(written);
+            firstCount = written + 1;
+        }
+        member->_writeOcr(top);
+        if (member->_phaseRunning) {
+            member->_retimePhaseOutputs(count, firstCount, top);
+        }
+        member->_setClock(timing[i].prescalerBits);
+    }
+    GTCCR = 0;
+    SREG = oldSREG;
+#endif
+    for (uint8_t i = 0; i < _count; i++) {
+        _members[i]->_requestedFrequency = frequencies[i];
+    }
+    _error = NO_ERROR;
+    return true;
+}
+
+void pulseTrainGroup::stop() {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_members[i]->_isRunning) {
+            mask |= 1UL << _members[i]->_timer_channel;
+        }
+    }
+    gptRegisters(0)->GTSTP = mask;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_members[i]->_isRunning) {
+            _members[i]->stop();
+        }
+    }
+#else
+    uint8_t oldSREG = SREG;
+    cli();
+    GTCCR = _BV(TSM) | _BV(PSRASY) | _BV(PSRSYNC);
+    for (uint8_t i = 0; i < _count; i++) {
+        _members[i]->stop();
+    }
+    GTCCR = 0;
+    SREG = oldSREG;
+#endif
+}
+
+void pulseTrainGroup::_measureSkew() {
+    // Reading the counters forward and then backward gives every member the same average sample
+    // time, so each pair of readings is the member's count at one common instant.
+    uint32_t first[PTO_GROUP_SIZE];
+    uint32_t second[PTO_GROUP_SIZE];
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    for (uint8_t i = 0; i < _count; i++) {
+        first[i] = gptRegisters(_members[i]->_timer_channel)->GTCNT;
+    }
+    for (uint8_t i = _count; i-- > 0;) {
+        second[i] = gptRegisters(_members[i]->_timer_channel)->GTCNT;
+    }
+#else
+    for (uint8_t i = 0; i < _count; i++) {
+        first[i] = _members[i]->_readCounter();
+    }
+    for (uint8_t i = _count; i-- > 0;) {
+        second[i] = _members[i]->_readCounter();
+    }
+#endif
+
+    int32_t reference = 0;
+    bool referenceKnown = false;
+    for (uint8_t i = 0; i < _count; i++) {
+        pulseTrainOutput* member = _members[i];
+        if (second[i] < first[i] || (i > 0 && !referenceKnown)) {
+            _skew[i] = PTO_SKEW_UNKNOWN;  // The counter reached its top between the two readings.
+            continue;
+        }
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+        uint8_t shift = member->_timer.get_cfg()->source_div;
+        int32_t cycles = (int32_t)(((first[i] + second[i]) << shift) / 2);
+#else
+        uint32_t divider = F_CPU / avrTimerClock(member->_is16bit, *member->_tccrB & (_BV(CS12) | _BV(CS11) | _BV(CS10)));
+        int32_t cycles = (int32_t)((first[i] + second[i]) * divider / 2);
+#endif
+        if (i == 0) {
+            reference = cycles;
+            referenceKnown = true;
+        }
+        _skew[i] = reference - cycles;    // Positive when the member started after the first one.
+    }
+}
+
+int32_t pulseTrainGroup::getSkew(uint8_t index) const {
+    if (index >= _count) {
+        return PTO_SKEW_UNKNOWN;
+    }
+    return _skew[index];
+}
+
+uint8_t pulseTrainGroup::getError() const {
+    return _error;
+}
+
+// --- Virtual Channels ---
+
+#define PTO_VIRTUAL_IDLE 0xFF             // virtualChannel::heapIndex of a channel that isn't running.
+
+// Timer counts that may pass between the scheduler reading TCNT and writing OCR.
+#define PTO_VIRTUAL_MARGIN_CYCLES 128
+
+// Compares two edge times on the scheduler's running clock, which wraps.
+static inline bool virtualEarlier(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+// The scheduler runs the 16-bit timers at /8 (0.5us counts at 16MHz), so one wrap covers 32ms.
+// Timer2 runs at /64 (4us) so that waiting out a slow channel doesn't cost an interrupt every 128us.
+static uint8_t virtualPrescaler(bool is16bit) {
+    return is16bit ? _BV(CS11) : _BV(CS22);
+}
+#endif
+
+pulseTrainScheduler::pulseTrainScheduler(pulseTrainOutput& timer) {
+    _timer = &timer;
+    _heapSize = 0;
+    _count = 0;
+    _now = 0;
+    _interval = 0;
+    _batchTicks = 0;
+    _marginTicks = 0;
+    _error = NO_ERROR;
+}
+
+bool pulseTrainScheduler::add(uint8_t pin) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    (void)pin;
+    _error = INVALID_MODE;                // The R4 has no PINx registers to toggle; see addAxis().
+    return false;
+#else
+    if (_timer->_timerId == TID_INVALID) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (_count >= PTO_MAX_VIRTUAL) {
+        _error = SCHEDULER_FULL;
+        return false;
+    }
+    uint8_t port = digitalPinToPort(pin);
+    if (port == NOT_A_PIN || _find(pin) != _count) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    virtualChannel& channel = _channels[_count];
+    channel.pinRegister = portInputRegister(port);
+    channel.pinBitMask = digitalPinToBitMask(pin);
+    channel.pin = pin;
+    channel.heapIndex = PTO_VIRTUAL_IDLE;
+    digitalWrite(pin, LOW);
+    pinMode(pin, OUTPUT);
+    _count++;                             // Last, as the channel is complete. The interrupt only reads running channels.
+    return true;
+#endif
+}
+
+bool pulseTrainScheduler::generate(uint8_t pin, uint32_t frequency, pulseModes mode, uint32_t pulses) {
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    (void)pin; (void)frequency; (void)mode; (void)pulses;
+    _error = INVALID_MODE;
+    return false;
+#else
+    uint8_t index = _find(pin);
+    if (index == _count) {
+        _error = INVALID_PIN;
+        return false;
+    }
+    if (mode != DISCRETE && mode != CONTINUOUS) {
+        _error = INVALID_MODE;
+        return false;
+    }
+    if (frequency == 0) {
+        _error = ZERO_HZ;
+        return false;
+    }
+    if (mode == DISCRETE && pulses == 0) {
+        _error = ZERO_PULSES;
+        return false;
+    }
+    pulseTrainOutput& timer = *_timer;
+    uint8_t prescalerBits = virtualPrescaler(timer._is16bit);
+    uint32_t clock = avrTimerClock(timer._is16bit, prescalerBits);
+    uint16_t batchTicks = (uint32_t)PTO_VIRTUAL_BATCH_US * clock / 1000000UL;
+    uint16_t marginTicks = (uint32_t)PTO_VIRTUAL_MARGIN_CYCLES * clock / F_CPU + 1;
+    uint32_t halfPeriod = (clock / frequency + 1) / 2;
+    if (halfPeriod <= (uint32_t)batchTicks + marginTicks) {
+        _error = FREQUENCY_HIGH;          // An edge would be due again before the interrupt could leave.
+        return false;
+    }
+    uint32_t longest = timer._is16bit ? 0x10000UL : 0x100UL;
+    virtualChannel& channel = _channels[index];
+
+    uint8_t oldSREG = SREG;
+    cli();
+    bool shared = timer._isRunning && timer._pulseMode == SCHEDULED && timer._scheduler == this;
+    if ((timer._isRunning && !shared) || (shared && channel.heapIndex != PTO_VIRTUAL_IDLE)) {
+        SREG = oldSREG;
+        _error = ACTIVE;
         return false;
     }
+    channel.halfPeriod = halfPeriod;
+    channel.togglesLeft = mode == DISCRETE ? pulses * 2 : 0;
+    if (!shared) {
+        // The heap may be stale if the timer was stopped by its own object.
+        for (uint8_t i = 0; i < _count; i++) {
+            _channels[i].heapIndex = PTO_VIRTUAL_IDLE;
+        }
+        _heapSize = 0;
+        _batchTicks = batchTicks;
+        _marginTicks = marginTicks;
+        _now = 0;
+        channel.next = halfPeriod;
+        _push(index);
+        _interval = halfPeriod < longest ? halfPeriod : longest;
+        pulseTiming timing = {(uint16_t)(_interval - 1), prescalerBits, 1};
+        timer._scheduler = this;
+        timer._pulseMode = SCHEDULED;
+        timer._startTimer(timing, true, false);
+    } else {
+        // A match still waiting for its interrupt hasn't been added to _now, and the counter has wrapped.
+        uint16_t count = timer._readCounter();
+        bool matched = *timer._tifr & (1 << timer._ocieBit);
+        if (matched) {
+            count = timer._readCounter();
+        }
+        channel.next = _now + (matched ? _interval : 0) + count + halfPeriod;
+        _push(index);
+        if (!matched && virtualEarlier(channel.next, _now + _interval)) {
+            // Sooner than the match already set, so bring the match forward.
+            uint32_t interval = channel.next - _now;
+            uint32_t reach = (uint32_t)timer._readCounter() + _marginTicks;
+            _interval = interval > reach ? interval : reach;
+            timer._writeOcr(_interval - 1);
+        }
+    }
+    SREG = oldSREG;
+    _error = NO_ERROR;
     return true;
+#endif
+}
+
+void pulseTrainScheduler::stop(uint8_t pin) {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    uint8_t index = _find(pin);
+    if (index == _count) {
+        return;
+    }
+    uint8_t oldSREG = SREG;
+    cli();
+    if (_channels[index].heapIndex != PTO_VIRTUAL_IDLE) {
+        _remove(index);
+        if (_heapSize == 0 && _timer->_isRunning && _timer->_pulseMode == SCHEDULED) {
+            _timer->stop();
+        }
+    }
+    digitalWrite(pin, LOW);
+    SREG = oldSREG;
+#else
+    (void)pin;
+#endif
+}
+
+void pulseTrainScheduler::stop() {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    uint8_t oldSREG = SREG;
+    cli();
+    if (_timer->_isRunning && _timer->_pulseMode == SCHEDULED && _timer->_scheduler == this) {
+        _timer->stop();
+    }
+    _heapSize = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        _channels[i].heapIndex = PTO_VIRTUAL_IDLE;
+        digitalWrite(_channels[i].pin, LOW);
+    }
+    SREG = oldSREG;
+#endif
 }
+
+bool pulseTrainScheduler::isRunning(uint8_t pin) const {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    uint8_t index = _find(pin);
+    uint8_t oldSREG = SREG;
+    cli();                                // The interrupt retires DISCRETE channels.
+    bool running = index != _count && _channels[index].heapIndex != PTO_VIRTUAL_IDLE
+        && _timer->_isRunning && _timer->_pulseMode == SCHEDULED && _timer->_scheduler == this;
+    SREG = oldSREG;
+    return running;
 #else
-bool pulseTrainOutput::_calculateTimingParameters(uint32_t, uint32_t&, uint8_t&) {
+    (void)pin;
     return false;
+#endif
+}
+
+uint8_t pulseTrainScheduler::getError() const {
+    return _error;
+}
+
+void pulseTrainScheduler::_service() {
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    _now += _interval;                    // This match ended the interval set last time.
+    volatile uint8_t* ports[PTO_MAX_VIRTUAL];
+    uint8_t toggles[PTO_MAX_VIRTUAL];
+    uint8_t portCount = 0;
+    uint32_t window = _batchTicks;
+    while (_heapSize != 0) {
+        uint8_t index = _heap[0];
+        virtualChannel& channel = _channels[index];
+        int32_t wait = (int32_t)(channel.next - _now);
+        if (wait > (int32_t)window) {
+            // An edge the counter could reach before OCR is written would wait a whole wrap, so take it now.
+            uint32_t reach = (uint32_t)_timer->_readCounter() + _marginTicks;
+            if (reach > window) {
+                window = reach;
+            }
+            if (wait > (int32_t)window) {
+                break;
+            }
+        }
+        uint8_t port = 0;
+        while (port < portCount && ports[port] != channel.pinRegister) {
+            port++;
+        }
+        if (port == portCount) {
+            ports[portCount] = channel.pinRegister;
+            toggles[portCount++] = 0;
+        }
+        toggles[port] ^= channel.pinBitMask;
+        if (channel.togglesLeft != 0 && --channel.togglesLeft == 0) {
+            _remove(index);               // DISCRETE trains end LOW, as they start.
+        } else {
+            channel.next += channel.halfPeriod;
+            _siftDown(0);
+        }
+    }
+    for (uint8_t i = 0; i < portCount; i++) {
+        *ports[i] = toggles[i];           // One write per port, so the edges that coincide on it move together.
+        PTO_MODEL_WRITE(ports[i]);
+    }
+    if (_heapSize == 0) {
+        _timer->stop();
+        return;
+    }
+    uint32_t wait = _channels[_heap[0]].next - _now;
+    uint32_t longest = _timer->_is16bit ? 0x10000UL : 0x100UL;
+    _interval = wait < longest ? wait : longest;  // A longer wait is made of empty matches.
+    _timer->_writeOcr(_interval - 1);
+#endif
+}
+
+uint8_t pulseTrainScheduler::_find(uint8_t pin) const {
+    uint8_t index = 0;
+    while (index < _count && _channels[index].pin != pin) {
+        index++;
+    }
+    return index;
+}
+
+void pulseTrainScheduler::_push(uint8_t channel) {
+    uint8_t slot = _heapSize++;
+    _heap[slot] = channel;
+    _siftUp(slot);
+}
+
+void pulseTrainScheduler::_remove(uint8_t channel) {
+    uint8_t slot = _channels[channel].heapIndex;
+    _channels[channel].heapIndex = PTO_VIRTUAL_IDLE;
+    uint8_t last = _heap[--_heapSize];
+    if (slot != _heapSize) {
+        // The last leaf fills the hole. It may belong above or below it.
+        _heap[slot] = last;
+        _siftDown(slot);
+        _siftUp(_channels[last].heapIndex);
+    }
+}
+
+void pulseTrainScheduler::_siftUp(uint8_t slot) {
+    uint8_t channel = _heap[slot];
+    uint32_t next = _channels[channel].next;
+    while (slot > 0) {
+        uint8_t parent = (slot - 1) / 2;
+        if (!virtualEarlier(next, _channels[_heap[parent]].next)) {
+            break;
+        }
+        _heap[slot] = _heap[parent];
+        _channels[_heap[slot]].heapIndex = slot;
+        slot = parent;
+    }
+    _heap[slot] = channel;
+    _channels[channel].heapIndex = slot;
+}
+
+void pulseTrainScheduler::_siftDown(uint8_t slot) {
+    uint8_t channel = _heap[slot];
+    uint32_t next = _channels[channel].next;
+    for (;;) {
+        uint8_t child = 2 * slot + 1;
+        if (child >= _heapSize) {
+            break;
+        }
+        if (child + 1 < _heapSize && virtualEarlier(_channels[_heap[child + 1]].next, _channels[_heap[child]].next)) {
+            child++;
+        }
+        if (!virtualEarlier(_channels[_heap[child]].next, next)) {
+            break;
+        }
+        _heap[slot] = _heap[child];
+        _channels[_heap[slot]].heapIndex = slot;
+        slot = child;
+    }
+    _heap[slot] = channel;
+    _channels[channel].heapIndex = slot;
 }
-#endif
\ No newline at end of file
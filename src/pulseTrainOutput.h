@@ -46,12 +46,21 @@
 // Platform-specific includes
 #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
 #include "FspTimer.h"
+#include "r_dtc.h"
 #endif
 
 enum pulseModes {
     STOP = 0,       // Not used, represents the stopped state.
     DISCRETE = 1,   // Generate a specific number of pulses and then stop.
-    CONTINUOUS = 2  // Generate a continuous, unending wave.
+    CONTINUOUS = 2, // Generate a continuous, unending wave.
+    MOVE = 3,       // A planned acceleration move started by move(). Not valid for generate().
+    COORDINATED = 4,// A multi-axis move started by moveAxes(). Not valid for generate().
+    PLAYBACK = 5,   // A table of intervals played by play(). Not valid for generate().
+    TRACKING = 6,   // A continuous wave that follows setTarget(), started by track(). Not valid for generate().
+    BURST = 7,      // Bursts of pulses repeated at a fixed period, started by burst(). Not valid for generate().
+    SCHEDULED = 8,  // The timer runs a pulseTrainScheduler's virtual channels. Not valid for generate().
+    WIDTH = 9,      // Pulses of a set width, started by generateWidth(). Not valid for generate().
+    STREAM = 10     // Periods fed from a RAM ring by the DTC, started by stream() (R4 only). Not valid for generate().
 };
 
 enum errors{
@@ -62,9 +71,106 @@ enum errors{
   INVALID_MODE = 4,        // An invalid mode was selected.
   FREQUENCY_HIGH = 5,      // The frequency is out of range.
   ZERO_PULSES = 6,         // Zero is not an allowable number of pulses.
-  TIMER_OPEN_FAILED = 7    // Zero is not an allowable number of pulses.
+  TIMER_OPEN_FAILED = 7,   // Zero is not an allowable number of pulses.
+  QUEUE_FULL = 8,          // The segment queue has no free slot.
+  COUNTER_UNAVAILABLE = 9, // The hardware counter timer is already in use, or this pin's timer is the counter.
+  AXIS_LIMIT = 10,         // All PTO_MAX_AXES axes are already attached.
+  GROUP_FULL = 11,         // The pulseTrainGroup already holds PTO_GROUP_SIZE members.
+  INVALID_TABLE = 12,      // play() was given an empty or odd-length table, an entry the timer can't count, or a divider it doesn't have.
+  INVALID_BURST = 13,      // burst() was given a period too short to hold its pulses.
+  SCHEDULER_FULL = 14,     // The pulseTrainScheduler already holds PTO_MAX_VIRTUAL channels.
+  INVALID_PHASE = 15,      // addPhaseOutput() was given a phase the timer can't produce.
+  INVALID_WIDTH = 16,      // generateWidth() or updateWidth() was given a width that rounds to 0 counts or fills the whole period.
+  INVALID_STREAM = 17      // stream() was given a ring shorter than 8 or of odd length, an entry the timer can't count, or a divider it doesn't have.
 };
 
+/**
+ * @brief The number of queue slots per pulseTrainOutput. One slot is always kept free, so this
+ * holds PTO_SEGMENT_QUEUE_SIZE - 1 segments behind the running train. Must be a power of two
+ * no larger than 128. Each slot costs 11 bytes of RAM per instance.
+ */
+#ifndef PTO_SEGMENT_QUEUE_SIZE
+#define PTO_SEGMENT_QUEUE_SIZE 4
+#endif
+
+/**
+ * @brief The number of step pins one pulseTrainOutput can drive in COORDINATED mode.
+ * Each axis costs 7 bytes of RAM per instance, and every axis adds to the interrupt time.
+ */
+#ifndef PTO_MAX_AXES
+#define PTO_MAX_AXES 4
+#endif
+
+/**
+ * @brief The shortest interrupt interval generateMilliHz() will dither, in microseconds. Shorter
+ * intervals leave the interrupt too little time to reload the compare value, so faster trains
+ * use the nearest whole count instead. 10us is about 50kHz on AVR and 100kHz on the R4.
+ */
+#ifndef PTO_DITHER_MIN_INTERVAL_US
+#define PTO_DITHER_MIN_INTERVAL_US 10
+#endif
+
+/**
+ * @brief Define PTO_PORTABLE_ISR to build the AVR compare vectors in C instead of hand-written assembly.
+ * Both count DISCRETE edges without calling handleInterrupt(); the assembly does it in 37 cycles
+ * (39 on the Mega) and the C in roughly twice that, as it saves more registers.
+ */
+// #define PTO_PORTABLE_ISR
+
+/**
+ * @brief Set to 1 to keep interrupt statistics for each pulseTrainOutput (see getStatistics()).
+ * Costs 29 bytes of RAM per instance and roughly 80 cycles per interrupt. On AVR the compare vectors
+ * are then built in C, as with PTO_PORTABLE_ISR, so that every edge is measured. At 0 nothing is compiled in.
+ */
+#ifndef PTO_ENABLE_STATISTICS
+#define PTO_ENABLE_STATISTICS 0
+#endif
+
+/**
+ * @brief Hooks for the host model in extras/host, which runs the library on a PC. PTO_MODEL_WRITE()
+ * follows each register write that does more than store a value (clearing TIFRn flags, toggling
+ * through PINx, blocking a compare match with a TCNTn write) and PTO_MODEL_READ() precedes each
+ * counter read, so that a busy-wait on the counter moves. Both take the register's address and are empty on a board.
+ */
+#ifndef PTO_MODEL_WRITE
+#define PTO_MODEL_WRITE(reg)
+#endif
+#ifndef PTO_MODEL_READ
+#define PTO_MODEL_READ(reg)
+#endif
+
+/**
+ * @brief The most pulseTrainOutput objects one pulseTrainGroup can hold.
+ */
+#ifndef PTO_GROUP_SIZE
+#define PTO_GROUP_SIZE 5
+#endif
+
+/**
+ * @brief The most virtual channels one pulseTrainScheduler can hold. Each costs 17 bytes of RAM.
+ */
+#ifndef PTO_MAX_VIRTUAL
+#define PTO_MAX_VIRTUAL 8
+#endif
+
+/**
+ * @brief pulseTrainScheduler edges due within this many microseconds of each other are output by
+ * the same interrupt, and those on one port by the same write.
+ */
+#ifndef PTO_VIRTUAL_BATCH_US
+#define PTO_VIRTUAL_BATCH_US 4
+#endif
+
+/**
+ * @brief The most phase outputs one pulseTrainOutput can drive: channels B and C of its timer.
+ */
+#define PTO_PHASE_OUTPUTS 2
+
+/**
+ * @brief Returned by pulseTrainGroup::getSkew() when a member wrapped before it could be sampled.
+ */
+#define PTO_SKEW_UNKNOWN INT32_MIN
+
 /**
  * @brief Internal enum to identify the specific hardware timer being used.
  */
@@ -82,6 +188,86 @@ enum timerIds {
     TID_INVALID
 };
 
+/**
+ * @brief Precomputed timer settings for one frequency.
+ * Produced by calculateTiming() and consumed by updateFrequency(const pulseTiming&),
+ * so code that sweeps through known frequencies does no arithmetic at update time.
+ */
+struct pulseTiming {
+    uint32_t top;            // AVR: the OCRnA value. R4: the raw period in timer counts.
+    uint8_t prescalerBits;   // AVR: the CS bits for TCCRnB. Unused on the R4.
+    uint16_t postscale;      // AVR: compare matches per output edge, for frequencies below the timer's range. 0 or 1 for none. Unused on the R4.
+};
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+/**
+ * @brief Solves the OCR value and prescaler bits for a frequency on an AVR timer (CTC toggle mode).
+ * Shared by pulseTrainOutput and pulseTrainTimer.
+ * @param is16bit true for Timer1/3/4/5, false for Timer2.
+ * @param frequency The target frequency in Hertz.
+ * @param timing A reference to the settings to fill in.
+ * @param minBits The fastest prescaler to consider, as CS bits. 2 (/8) leaves out clk/1.
+ * @return true if a valid setting is found, false if the frequency is out of range.
+ */
+bool avrSolveTiming(bool is16bit, uint32_t frequency, pulseTiming& timing, uint8_t minBits = 1);
+#endif
+
+/**
+ * @brief One queued DISCRETE train: its precomputed timer settings and how many pulses to emit.
+ */
+struct pulseSegment {
+    pulseTiming timing;      // The timer settings for the segment's frequency.
+    uint32_t pulses;         // The number of HIGH pulses in the segment.
+};
+
+/**
+ * @brief How far a train got before abort() stopped it.
+ */
+struct pulseTrainReport {
+    uint32_t emitted;        // Pulses whose rising edge had left, a cut one included.
+    uint32_t remaining;      // Pulses of the train that never started. Queued segments aren't included.
+    bool truncated;          // true if the pin was HIGH, so the last emitted pulse was cut short.
+};
+
+/**
+ * @brief A snapshot of one channel's interrupt statistics (see getStatistics()).
+ * Times are in timer counts at the current prescaler. Multiply by cyclesPerCount for CPU cycles.
+ */
+struct pulseTrainStatistics {
+    uint32_t pulses;         // Rising edges seen by the interrupt. Trains counted by the hardware counter aren't included.
+    uint32_t interrupts;     // Compare interrupts (AVR) or overflow callbacks (R4) taken.
+    uint32_t missed;         // Matches detected as never handled, each one possibly an edge lost from the count.
+    uint16_t maxLatency;     // The longest time from a match to its interrupt starting.
+    uint16_t maxDuration;    // The longest interrupt.
+    uint16_t meanDuration;   // The average interrupt. The one that stops a train isn't timed.
+    uint16_t cyclesPerCount; // CPU cycles per timer count. 0 when the timer is stopped.
+};
+
+/**
+ * @brief One step pin driven by the coordinated DDA (see moveAxes()).
+ */
+struct ddaAxis {
+    uint32_t steps;          // The steps this axis makes in the current move.
+    uint32_t accumulator;    // The Bresenham error term. An axis steps each time it passes the major axis count.
+    uint8_t portIndex;       // Index of the axis's PORTx register in the instance's port list.
+    uint8_t pinBitMask;      // The bitmask for the pin within its PORT.
+};
+
+/**
+ * @brief One software-timed output of a pulseTrainScheduler.
+ */
+struct virtualChannel {
+    uint32_t next;           // The timer count of the channel's next edge, on the scheduler's running clock.
+    uint32_t halfPeriod;     // Timer counts between edges.
+    uint32_t togglesLeft;    // Edges left in a DISCRETE train, or 0 for CONTINUOUS.
+    volatile uint8_t* pinRegister; // The PINx register. Writing a one to it toggles the PORTx bit.
+    uint8_t pinBitMask;      // The bitmask for the pin within its PORT.
+    uint8_t pin;             // The Arduino pin number, to find the channel by.
+    uint8_t heapIndex;       // The channel's slot in the scheduler's heap, or 0xFF while idle.
+};
+
+class pulseTrainScheduler;
+
 /**
  * @brief A C++ class to control Arduino hardware timers for precise pulse/frequency generation.
  * * This class abstracts the low-level timer registers of the AVR microcontroller,
@@ -89,13 +275,31 @@ enum timerIds {
  * timer-enabled pins on both Arduino Uno and Mega boards.
  */
 class pulseTrainOutput{
+    friend class pulseTrainGroup;         // Writes the timers of several members between one hold and release.
+    friend class pulseTrainScheduler;     // Runs the timer as the clock of its virtual channels.
   public:
+    /**
+     * @brief A function called from the interrupt when a train runs to its end (see onComplete()).
+     */
+    typedef void (*completionCallback)(pulseTrainOutput& output);
+
+    /**
+     * @brief A function called from the interrupt to refill half of a stream() ring (see stream()).
+     * It writes up to length periods and HIGH times, in timer counts, and returns how many it wrote.
+     */
+    typedef uint16_t (*streamRefill)(pulseTrainOutput& output, uint32_t periods[], uint32_t highs[], uint16_t length);
+
     /**
      * @brief An array of static pointers, one for each timer, allowing the global C-style
      * ISRs to find and call the correct C++ object instance. Sized for R4 compatibility.
      */
     static pulseTrainOutput* _instances[10];
 
+    /**
+     * @brief The object that owns the hardware pulse counter timer, if any (see useHardwareCounter()).
+     */
+    static pulseTrainOutput* _counterOwner;
+
     /**
      * @brief Construct a new pulseTrainOutput object.
      * @param pin The Arduino digital pin to control. Must be a timer-enabled pin.
@@ -111,22 +315,376 @@ class pulseTrainOutput{
      * @return false if the pin is invalid, the timer is already running, or the frequency is out of range.
      */
     bool generate(uint32_t frequency, pulseModes mode = CONTINUOUS, uint32_t pulses = 1);
+
+    /**
+     * @brief Generates a pulse train at a frequency given in millihertz.
+     * A timer can only divide its clock by a whole count, so most frequencies fall between two
+     * counts. With dithering, the interrupt alternates the count between the two, sigma-delta style,
+     * so the long-run average matches the request to a fraction of a ppm of the CPU clock. This
+     * needs an interrupt on every edge (AVR) or pulse (R4), even in CONTINUOUS mode. Without
+     * dithering the nearest count is used, and CONTINUOUS trains need no interrupt at all.
+     * @param milliHertz The desired frequency in thousandths of a Hertz (e.g. 300000000 for 300kHz).
+     * @param mode The operating mode (DISCRETE or CONTINUOUS).
+     * @param pulses The number of HIGH pulses to generate in DISCRETE mode. Ignored in CONTINUOUS mode.
+     * @param dither true to dither between counts, false for the nearest count. Intervals shorter than
+     * PTO_DITHER_MIN_INTERVAL_US are never dithered.
+     * @return true if the frequency is achievable and the timer was started.
+     * @return false if the pin is invalid, the timer is already running, or the frequency is out of range.
+     */
+    bool generateMilliHz(uint64_t milliHertz, pulseModes mode = CONTINUOUS, uint32_t pulses = 1, bool dither = true);
     
     /**
-     * @brief Instantly updates the frequency, changing the prescaler if necessary.
-     * This may cause a minor timing glitch (a single malformed pulse) at the moment
-     * of the prescaler change on AVR boards.
+     * @brief Generates a planned move: exactly 'steps' pulses that accelerate from vStart to vMax,
+     * cruise, and decelerate back to vStart. The ramp is advanced inside the interrupt with
+     * fixed-point period updates (no division per pulse), so it doesn't depend on loop() timing.
+     * With jerk set to zero the profile is trapezoidal. Otherwise the acceleration itself ramps
+     * (an S-curve), and vMax is lowered if the move is too short to reach it.
+     * @param steps The number of pulses to generate.
+     * @param vStart The starting and finishing frequency in Hertz (steps per second).
+     * @param vMax The cruising frequency in Hertz.
+     * @param accel The acceleration in steps per second squared. Zero gives a constant vStart move.
+     * @param jerk The rate of change of acceleration in steps per second cubed. Zero gives a trapezoidal ramp.
+     * @return true if the move was planned and started.
+     * @return false if the pin is invalid, the timer is already running, or vStart/vMax are out of range.
+     */
+    bool move(uint32_t steps, uint32_t vStart, uint32_t vMax, uint32_t accel, uint32_t jerk = 0);
+
+    /**
+     * @brief Plays a table of edge intervals straight from flash, for irregular pulse spacing.
+     * Entry 0 is the LOW time before the first rising edge, entry 1 that pulse's HIGH time, entry 2
+     * the LOW time before the next pulse, and so on, each in raw timer counts. The interrupt reads
+     * the table in place, one entry per edge, so it is never copied to RAM. On AVR it must be
+     * declared PROGMEM. On the R4 a const array is already in flash.
+     * Each entry must be at least 1 and at most 65535 (256 on Timer2, 32768 on the R4's 16-bit GPT
+     * channels, where a HIGH and LOW pair share one period). When looping, the next pass starts from
+     * the interrupt, so entry 0 must outlast it (about 15us on AVR). updateFrequency() doesn't apply.
+     * @param intervals The table. It must stay valid until playback ends.
+     * @param length The number of entries. Must be even, so the table ends on a falling edge.
+     * @param divider The timer clock divider the counts are in. AVR: 1, 8, 64, 256 or 1024 (Timer2 also
+     * 32 and 128). R4: 1, 4, 16, 64, 256 or 1024, on GPT pins only.
+     * @param repeats The number of times to play the table, or 0 to loop until stop().
+     * @return true if playback started.
+     * @return false if the timer is running (ACTIVE), the table or divider is invalid (INVALID_TABLE), or the pin is on an R4 AGT (INVALID_MODE).
+     */
+    bool play(const uint16_t intervals[], uint16_t length, uint16_t divider, uint16_t repeats = 1);
+
+    /**
+     * @brief Checks if the last play() has played all of its repeats. A playback ended by stop() never completes.
+     * @return true once the final falling edge of the final pass has been output.
+     */
+    bool isPlaybackDone() const;
+
+    /**
+     * @brief Repeats a burst of pulses at a fixed period, with the timer and interrupt doing all the gating.
+     * Bursts start every periodMicros to within one timer count, however long loop() takes. Between bursts
+     * the interrupt only runs once per timer wrap, to reload the compare for the gap.
+     * @param frequency The pulse frequency inside a burst, in Hertz.
+     * @param pulses The pulses in each burst.
+     * @param periodMicros The time from the start of one burst to the start of the next.
+     * @param bursts How many bursts to output, or 0 to repeat until stop().
+     * @return false if the timer is running (ACTIVE), the frequency is 0 (ZERO_HZ) or out of range (FREQUENCY_HIGH),
+     * pulses is 0 (ZERO_PULSES), or the period leaves no gap after the pulses (INVALID_BURST).
+     */
+    bool burst(uint32_t frequency, uint32_t pulses, uint32_t periodMicros, uint32_t bursts = 0);
+
+    /**
+     * @brief Outputs pulses of a fixed width at a frequency, for loads that need a set on-time
+     * whatever the rate (e.g. a laser). The timer runs in fast PWM, so a CONTINUOUS train needs no
+     * interrupt and a DISCRETE one takes one per pulse instead of one per edge. Each period is LOW
+     * first and ends with its pulse.
+     * AVR: 16-bit timers only, with ICRn as TOP and OCRnA as the width. Timer2's only TOP register is
+     * the output's own compare, so it can't. R4: GPT pins only.
+     * @param frequency The pulse frequency in Hertz.
+     * @param widthNanos The HIGH time of each pulse in nanoseconds, rounded to the nearest timer count.
+     * @param mode DISCRETE or CONTINUOUS.
+     * @param pulses The number of pulses in DISCRETE mode. Ignored in CONTINUOUS mode.
+     * @return false if the timer is running (ACTIVE), the frequency is 0 (ZERO_HZ) or out of range
+     * (FREQUENCY_HIGH), pulses is 0 (ZERO_PULSES), the width doesn't fit the period (INVALID_WIDTH),
+     * or the mode or timer can't (INVALID_MODE).
+     */
+    bool generateWidth(uint32_t frequency, uint32_t widthNanos, pulseModes mode = CONTINUOUS, uint32_t pulses = 1);
+
+    /**
+     * @brief Changes the frequency and width of a generateWidth() train together, so every period is
+     * wholly old or wholly new. The prescaler (AVR) or divider (R4) chosen by generateWidth() is kept.
+     * On AVR the overflow interrupt loads the width and then the period over two period boundaries.
+     * Updates made faster than that replace each other; the last one wins.
+     * On the R4 the GPT buffers both. They're written clear of the period's end, which may wait up to 10us.
+     * @param frequency The new pulse frequency in Hertz.
+     * @param widthNanos The new HIGH time in nanoseconds.
+     * @return false if no generateWidth() train is running (INVALID_MODE), the frequency is 0 (ZERO_HZ)
+     * or out of range for the divider (FREQUENCY_HIGH), or the width doesn't fit (INVALID_WIDTH).
+     */
+    bool updateWidth(uint32_t frequency, uint32_t widthNanos);
+
+    /**
+     * @brief Streams pulses from a ring in RAM with no CPU time per pulse (R4 only). The Data Transfer
+     * Controller is triggered by the GPT overflow, and copies the next period and HIGH time into the
+     * GPT's buffer registers, so each takes effect at the end of the period after. The ring is split
+     * into two halves. When the DTC finishes one, the interrupt starts it on the other and calls refill
+     * with the half just played, so a long profile can be computed while it runs. Only these
+     * half-complete interrupts, and the two at the end, use the CPU.
+     * The periods are rewritten in place to the register values (one less), so refill the ring rather
+     * than reuse it. Each period must be at least 2 counts and fit the channel (65536 counts on the
+     * 16-bit GPT channels), and each HIGH time from 1 to one less than its period. Each period must also
+     * outlast the half-complete interrupt (a few microseconds), and refill must return before the other
+     * half runs out. getPosition() counts the pulses as they start. updateFrequency() doesn't apply.
+     * @param periods The period of each pulse in timer counts. Must stay valid until the train ends.
+     * @param highs The HIGH time of each pulse in timer counts, each period starting HIGH.
+     * @param length The number of entries in each array. Must be even and at least 8.
+     * @param divider The timer clock divider the counts are in: 1, 4, 16, 64, 256 or 1024.
+     * @param refill Fills a played half, or nullptr to play the ring once. Returning fewer than the
+     * half's length ends the train after those entries.
+     * @return false if the timer is running (ACTIVE), the ring or divider is invalid (INVALID_STREAM),
+     * the DTC couldn't be opened (TIMER_OPEN_FAILED), or the board or pin can't (INVALID_MODE).
+     */
+    bool stream(uint32_t periods[], uint32_t highs[], uint16_t length, uint16_t divider, streamRefill refill = nullptr);
+
+    /**
+     * @brief Starts a continuous wave that follows setTarget(), for turning a stream of readings into a frequency.
+     * The interrupt applies each new target at the next period boundary, so loop() never solves the timer.
+     * @param frequency The starting frequency in Hertz.
+     * @param maxStepHz The most the frequency may change at one period boundary. 0 jumps straight to each target.
+     * @param deadbandHz A target within this of the current frequency is ignored. 0 follows every change.
+     * @return false if the timer is running (ACTIVE), the frequency is 0 (ZERO_HZ) or out of range (FREQUENCY_HIGH).
+     */
+    bool track(uint32_t frequency, uint32_t maxStepHz = 0, uint32_t deadbandHz = 0);
+
+    /**
+     * @brief Posts a new target frequency to a running track(). Lock-free: the target goes into a two-slot
+     * mailbox that the interrupt reads, so this takes a few cycles and never holds interrupts off for long.
+     * The latest target wins. A target of 0 or one the timer can't produce holds the current frequency.
+     * @param frequency The target in Hertz.
+     */
+    void setTarget(uint32_t frequency);
+
+    /**
+     * @brief Counts DISCRETE pulses in hardware instead of with one interrupt per edge (AVR only).
+     * Wire this object's output pin to the counter pin: D5 (T1) on the Uno, D47 (T5) on the Mega.
+     * That timer then counts the pulses and interrupts only on the rising edge of the last one,
+     * so trains of 3 or more pulses cost two interrupts in total, whatever the frequency or count.
+     * The counter timer's own output pin (D9 on the Uno, D46 on the Mega) can't be used at the same time.
+     * The last pulse is exact as long as the counter interrupt is serviced within one period.
+     * @param counterPin The counter input pin the output is wired to.
+     * @return true if hardware counting is now used for this object.
+     * @return false if the pin is not the board's counter input, or the counter timer is in use.
+     */
+    bool useHardwareCounter(uint8_t counterPin);
+
+    /**
+     * @brief The interrupt handler for the hardware pulse counter. Called by the counter timer's ISR.
+     */
+    void handleCounterInterrupt();
+
+    /**
+     * @brief The interrupt handler for the timer's overflow, which counts generateWidth() pulses and
+     * commits updateWidth() (AVR only). Called by the overflow ISR.
+     */
+    void handleOverflowInterrupt();
+
+    /**
+     * @brief Drives another output pin of this object's timer as a copy of the output, lagging it by a
+     * phase. It shares the timer's period, so it costs no interrupts.
+     * AVR: the timer's channel B and C pins, at any phase to within one timer count. Uno: 10 (with 9)
+     * and 3 (with 11). Mega: 12 and 13 (with 11), 9 (with 10), 2 and 3 (with 5), 7 and 8 (with 6), 45 and 44 (with 46).
+     * R4: the other pin of the same GPT channel, at 0 or 180 degrees.
+     * Phase outputs run with DISCRETE and CONTINUOUS trains from generate(), generateMilliHz() without
+     * dither, queue() and pulseTrainGroup, and follow updateFrequency(). Other modes leave them LOW.
+     * In DISCRETE mode they stop with the output, so a lagging output's last pulse is cut short.
+     * @param pin The pin. Adding a pin again changes its phase.
+     * @param phaseDegrees How far the pin lags the output, 0 to 359. 180 gives the complement.
+     * @return false if a train is running (ACTIVE), the pin isn't on this timer (INVALID_PIN), or the
+     * phase is out of range or, on the R4, not 0 or 180 (INVALID_PHASE).
+     */
+    bool addPhaseOutput(uint8_t pin, uint16_t phaseDegrees = 0);
+
+    /**
+     * @brief Detaches every pin added with addPhaseOutput() and drives them LOW. On the R4 a train
+     * that drives them is stopped first.
+     */
+    void clearPhaseOutputs();
+
+    /**
+     * @brief Attaches a step pin to this object's coordinated DDA (AVR only).
+     * Any digital pin can be an axis. Its edges are written straight to PORTx from this object's
+     * timer interrupt, so all axes on one object share a time base and finish a move together.
+     * @param stepPin The digital pin to drive. Axes are numbered in the order they're added.
+     * @return true if the axis was added.
+     * @return false if the pin has no port, all PTO_MAX_AXES are in use (AXIS_LIMIT), or a move is running.
+     */
+    bool addAxis(uint8_t stepPin);
+
+    /**
+     * @brief Detaches every axis added with addAxis().
+     */
+    void clearAxes();
+
+    /**
+     * @brief Starts a coordinated linear move: each axis makes its own number of steps, spread
+     * evenly by a Bresenham/DDA interpolator over the steps of the longest axis.
+     * All axes start on the same interrupt and make their last step on the same interrupt.
+     * @param steps An array with one step count per axis, in addAxis() order.
+     * @param frequency The step rate of the longest axis in Hertz. The other axes step proportionally slower.
+     * @return true if the move was started.
+     * @return false if no axes are attached, every count is zero, or the frequency is out of range.
+     */
+    bool moveAxes(const uint32_t steps[], uint32_t frequency);
+
+    /**
+     * @brief Queues a DISCRETE train to follow the current one with no gap between them.
+     * When the running train's last pulse ends, the interrupt loads the next segment straight
+     * into the timer. If nothing is running the segment starts immediately.
+     * Interrupts are never disabled while a segment is added to a running train.
+     * @param frequency The frequency of the segment in Hertz.
+     * @param pulses The number of HIGH pulses in the segment.
+     * @return true if the segment was queued (or started).
+     * @return false if the queue is full (QUEUE_FULL), the frequency or pulse count is invalid, or a
+     * train other than DISCRETE is running (INVALID_MODE).
+     */
+    bool queue(uint32_t frequency, uint32_t pulses);
+
+    /**
+     * @brief Queues a DISCRETE train using settings precomputed with calculateTiming().
+     * On the R4 this needs the timer to be running, as the settings depend on its divider.
+     * @param timing The precomputed timer settings.
+     * @param pulses The number of HIGH pulses in the segment.
+     * @return true if the segment was queued (or started).
+     * @return false if the queue is full (QUEUE_FULL), the pulse count is zero, or a train other than
+     * DISCRETE is running (INVALID_MODE).
+     */
+    bool queue(const pulseTiming& timing, uint32_t pulses);
+
+    /**
+     * @brief Returns how many segments are waiting behind the running train.
+     */
+    uint8_t queuedSegments() const;
+
+    /**
+     * @brief Updates the frequency at the next period boundary, changing the prescaler if necessary.
+     * On AVR the new settings are staged and committed by the compare interrupt on the match that
+     * starts the next HIGH half, so every period is wholly the old frequency or wholly the new one.
+     * Updates made faster than the output period replace each other; the last one wins.
+     * On the R4 the GPT buffers the period and duty itself, with the same result.
      * @param newFrequency The new frequency in Hertz.
      * @return true if the frequency was updated successfully.
-     * @return false if the timer is not running or the frequency is out of range.
+     * @return false if the timer is not running or the frequency is out of range (FREQUENCY_HIGH),
+     * which for a MOVE includes one too low to reach without postscaling (AVR).
      */
     bool updateFrequency(uint32_t newFrequency);
+
+    /**
+     * @brief Applies timer settings previously produced by calculateTiming(), at the next period
+     * boundary like updateFrequency(uint32_t).
+     * No division or prescaler search is done, which makes this the cheapest way to ramp.
+     * @param timing The precomputed settings.
+     * @return true if the settings were applied.
+     * @return false if the timer is not running.
+     */
+    bool updateFrequency(const pulseTiming& timing);
+
+    /**
+     * @brief Solves the timer settings for a frequency without touching the hardware.
+     * On the R4 the result is relative to the clock divider chosen by generate(), so it
+     * can only be calculated while the timer is running.
+     * @param frequency The frequency in Hertz.
+     * @param timing A reference to the settings to fill in.
+     * @return true if the frequency is achievable.
+     * @return false if the frequency is out of range (the error is set to FREQUENCY_HIGH).
+     */
+    bool calculateTiming(uint32_t frequency, pulseTiming& timing);
     
     /**
      * @brief Immediately stops the pulse train generation.
      */ 
     void stop();
 
+    /**
+     * @brief Holds a running DISCRETE train LOW at its next low phase, so no pulse is cut short.
+     * On AVR the timer freezes at once if the pin is LOW, or on the falling edge that ends the current
+     * pulse. On the R4 the pin is kept LOW from the end of the current period. Phase outputs hold the
+     * level they had. isPaused() tells when the hold has taken effect.
+     * @return true if the pause is set, false if no DISCRETE train is running (INVALID_MODE).
+     */
+    bool pause();
+
+    /**
+     * @brief Continues a paused train from where it was held, with no pulse lost or added. A pause
+     * that hasn't taken effect yet is withdrawn.
+     * @return true if the train carries on, false if none is running (INVALID_MODE).
+     */
+    bool resume();
+
+    /**
+     * @brief Returns true while a paused train is held LOW.
+     */
+    bool isPaused() const;
+
+    /**
+     * @brief Stops the train within a fixed number of cycles, on a clean falling edge, and reports how far it got.
+     * Interrupts go off on entry and the output compare unit forces the pin LOW a fixed run of
+     * instructions later, about 50 CPU cycles (3us at 16MHz) on AVR counted from the code, so the worst
+     * case is that plus any interrupt already running when it's called. A pulse that was HIGH is cut
+     * short and reported as truncated. Queued segments are dropped, as with stop().
+     * @param report Gets the emitted and remaining pulses of the current DISCRETE train or move, or 0
+     * in the other modes.
+     * @return true if a train was running.
+     */
+    bool abort(pulseTrainReport& report);
+
+    /**
+     * @brief Drives a stepper driver's direction pin from setDirection().
+     * The pin is set to the current direction straight away.
+     * @param pin Any digital pin.
+     * @param setupMicros How long the pin must settle before the next step edge. setDirection() waits this long after a change.
+     * @return true if the pin was attached, false if a train is running (ACTIVE).
+     */
+    bool setDirectionPin(uint8_t pin, uint16_t setupMicros = 5);
+
+    /**
+     * @brief Sets the direction the next trains move in. The position counts up going forward and down in reverse.
+     * If the direction pin changes, this waits out its setup time, so the first step edge can follow at once.
+     * @param forward true for forward (direction pin HIGH), false for reverse (LOW).
+     * @return true if the direction was set, false if a train is running (ACTIVE).
+     */
+    bool setDirection(bool forward);
+
+    /**
+     * @brief The absolute position, in pulses, as a tear-free snapshot. Moved by DISCRETE trains
+     * (including queued ones) and move(), as each pulse's rising edge leaves on AVR and as each
+     * period ends on the R4. With useHardwareCounter() it jumps when the train ends.
+     * @return The position.
+     */
+    int32_t getPosition() const;
+
+    /**
+     * @brief Sets the absolute position, e.g. after homing.
+     * @param position The new position.
+     * @return true if it was set, false if a train is running (ACTIVE).
+     */
+    bool setPosition(int32_t position);
+
+    /**
+     * @brief The pulses of the current DISCRETE train or move() emitted so far, as a tear-free snapshot.
+     * @return The pulse count, or 0 when nothing is running.
+     */
+    uint32_t getPulsesEmitted() const;
+
+    /**
+     * @brief Sets a function to call when a train runs to its end (DISCRETE with its queue, move(),
+     * moveAxes() and play()). It runs inside the interrupt, so keep it short. stop() doesn't call it.
+     * getPosition(), getPulsesEmitted(), getFrequencyError(), onComplete(), pollComplete(), queue(),
+     * getStatistics() and resetStatistics() leave interrupts as they found them, so it may call them.
+     * @param callback The function, or nullptr for none.
+     */
+    void onComplete(completionCallback callback);
+
+    /**
+     * @brief Checks the completion event raised when a train runs to its end, and clears it.
+     * Lets loop() sleep or do other work instead of polling isRunning() in a tight loop.
+     * @return true if a train has completed since the last call.
+     */
+    bool pollComplete();
+
     /**
      * @brief Checks if the timer is currently generating pulses.
      * @return true if the timer is active, false otherwise.
@@ -139,12 +697,49 @@ class pulseTrainOutput{
      */
     uint8_t getError() const;
 
+    /**
+     * @brief The frequency the timer actually produces, worked back from its period and prescaler.
+     * An update still waiting for the period boundary is reported as if it had landed.
+     * @return The output frequency in Hertz, or 0 if the timer is not running.
+     */
+    float getActualFrequency() const;
+
+    /**
+     * @brief How far the output is from the frequency last asked for, as getActualFrequency() minus the request.
+     * Moves, queued segments and updates from precomputed timing carry no request and read 0.
+     * @return The error in Hertz.
+     */
+    float getFrequencyError() const;
+
      /**
      * @brief The C++ interrupt handler method. This is called by the global ISR trampolines or R4 callback.
      * It contains the logic for counting discrete pulses.
      */
     void handleInterrupt();
 
+#if PTO_ENABLE_STATISTICS
+    /**
+     * @brief Copies the interrupt statistics in one atomic read.
+     * @param stats A reference to the snapshot to fill in.
+     */
+    void getStatistics(pulseTrainStatistics& stats) const;
+
+    /**
+     * @brief Zeroes the interrupt statistics.
+     */
+    void resetStatistics();
+
+    /**
+     * @brief Samples the time since the match. Called first thing by the compare vector (AVR) or handleInterrupt() (R4).
+     */
+    void recordInterruptEntry();
+
+    /**
+     * @brief Times the interrupt and checks whether the next match came before it finished. Called last.
+     */
+    void recordInterruptExit();
+#endif
+
     #if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
     /**
      * @brief Static callback functions, one for each possible GPT timer channel on the R4.
@@ -161,13 +756,217 @@ class pulseTrainOutput{
 
 private:
     /**
-     * @brief Private helper function to calculate the optimal OCR value and prescaler settings for a given frequency (AVR only).
+     * @brief Validates a generate() request and readies the counters and timer settings without starting the timer.
+     * On the R4 the FspTimer is opened here, with sourceDiv passed on to _openTimer(). On AVR 'timing' receives the solved settings.
+     * @return true if the train is ready to start, false with the error set otherwise.
+     */
+    bool _prepareGenerate(uint32_t frequency, pulseModes mode, uint32_t pulses, pulseTiming& timing, int8_t sourceDiv = -1);
+
+    /**
+     * @brief Private helper function to calculate the OCR value and prescaler settings for a given frequency.
+     * Every prescaler is tried with the compare value either side of the ideal one, and the pair
+     * whose frequency lands closest to the request wins. Ties go to the smaller prescaler.
      * @param frequency The target frequency in Hertz.
-     * @param ocrValue A reference to a variable where the calculated OCR value will be stored.
-     * @param prescalerBits A reference to a variable where the calculated TCCRB register bits for the prescaler will be stored.
+     * @param timing A reference to the settings where the OCR value (or R4 period) and prescaler bits will be stored.
      * @return true if a valid setting is found, false if the frequency is out of range.
      */
-    bool _calculateTimingParameters(uint32_t frequency, uint32_t& ocrValue, uint8_t& prescalerBits);
+    bool _calculateTimingParameters(uint32_t frequency, pulseTiming& timing);
+
+    /**
+     * @brief Finds the count for one interrupt interval at a millihertz frequency: the whole part in 'timing'
+     * and the fractional part, in 1/2^32 of a count, in 'fraction'. On the R4 the timer must be open.
+     * @return true if the count fits the timer, false if the frequency is out of range.
+     */
+    bool _solveMilliHz(uint64_t milliHertz, pulseTiming& timing, uint32_t& fraction);
+
+    /**
+     * @brief Advances the planned move by one interrupt interval (MOVE mode only).
+     * @return The length of the next interval in timer counts.
+     */
+    uint32_t _advanceRamp();
+
+    /**
+     * @brief Loads the oldest queued segment into the timer. Called from the interrupt when a train ends.
+     * @return true if a segment was loaded, false if the queue was empty.
+     */
+    bool _loadNextSegment();
+
+    /**
+     * @brief Ends a train that ran its course: stops it, raises the completion event and calls the callback.
+     */
+    void _finish();
+
+    /**
+     * @brief Works out how many pulses the current DISCRETE train or move has emitted. Call with the
+     * timer's interrupt unable to run.
+     */
+    uint32_t _pulsesEmitted() const;
+
+    /**
+     * @brief Adds the pulses emitted by the current train to the position. Call with the timer's interrupt unable to run.
+     */
+    void _foldPosition();
+
+    /**
+     * @brief Freezes the timer for pause() once the pin is LOW. Call with the timer's interrupt unable to run.
+     */
+    void _holdPaused();
+
+    /**
+     * @brief Starts the next pass of a play() table, or ends playback after the last one.
+     * On AVR this is called on the edge after a pass's last entry. On the R4 it's called by _playFetch().
+     * @return true if another pass started, false if playback is over.
+     */
+    bool _nextPlaybackPass();
+
+    /**
+     * @brief Takes the latest setTarget() and moves the frequency one slew step towards it (TRACKING mode only).
+     * Called by the interrupt at a period boundary. The timer is only written if its settings change.
+     * @return true if the frequency has still to reach the target.
+     */
+    bool _advanceTracking();
+
+    /**
+     * @brief Ends a burst and starts the gap to the next one, once its last pulse has been output (BURST mode only).
+     * @return false if that was the last burst.
+     */
+    bool _startBurstGap();
+
+    /**
+     * @brief Moves the gap between bursts on by one timer period, and starts the next burst at its end (BURST mode only).
+     */
+    void _advanceBurstGap();
+
+    /**
+     * @brief Loads the timer period for one piece of the gap between bursts (BURST mode only).
+     * @param index Which piece, from 0.
+     */
+    void _loadBurstChunk(uint32_t index);
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    /**
+     * @brief Starts a train readied by _prepareGenerate(), arming the hardware counter if it's in use (AVR only).
+     */
+    void _launch(const pulseTiming& timing, uint32_t pulses);
+
+    /**
+     * @brief Configures the timer for CTC toggle output and starts its clock (AVR only).
+     * The interrupt flag is restored afterwards rather than set, so this can run inside a longer critical section.
+     * @param timing The OCR value and prescaler bits to start with.
+     * @param countPulses true to enable the compare interrupt that counts pulses.
+     * @param drivePin false to leave the pin disconnected from the timer, so only the interrupt runs.
+     */
+    void _startTimer(const pulseTiming& timing, bool countPulses, bool drivePin = true);
+
+    /**
+     * @brief Resets the hardware counter timer and arms it to interrupt on the last of 'pulses' rising edges (AVR only).
+     */
+    void _armCounter(uint32_t pulses);
+
+    /**
+     * @brief Works out the compare value that delays a phase output by its phase, and the level it
+     * starts a train at (AVR only).
+     * @param index The phase output.
+     * @param top The OCRnA value of the timing it runs with.
+     * @param high Set to true if the output starts HIGH.
+     * @return The OCRnB or OCRnC value.
+     */
+    uint16_t _phaseCompare(uint8_t index, uint16_t top, bool& high) const;
+
+    /**
+     * @brief Loads the phase outputs for a new train and connects them to the timer (AVR only).
+     * Call with the clock stopped.
+     */
+    void _startPhaseOutputs(uint16_t top);
+
+    /**
+     * @brief Rescales the phase outputs to a new top while the clock is held (AVR only). A phase
+     * output whose edge for this half period would be missed, or repeated, is toggled by hand.
+     * @param oldCount The counter when the clock stopped.
+     * @param firstCount The first count, in the new prescaler's units, that can still match. Writing
+     * TCNT blocks a match on the count written, so that's one more than a written count.
+     * @param top The new OCRnA value.
+     */
+    void _retimePhaseOutputs(uint16_t oldCount, uint16_t firstCount, uint16_t top);
+
+    /**
+     * @brief Parks the phase outputs LOW and disconnects them from the timer (AVR only).
+     */
+    void _stopPhaseOutputs();
+
+    /**
+     * @brief Stops the hardware counter timer and its interrupt (AVR only).
+     */
+    void _stopCounter();
+
+    /**
+     * @brief Hands all but the last toggle of a DISCRETE train to the compare vector's fast path, which counts them without calling handleInterrupt() (AVR only). Call with the
+     * compare interrupt unable to run.
+     */
+    void _delegateCount();
+
+    /**
+     * @brief Takes back the toggles the fast path hasn't counted yet, so every edge reaches handleInterrupt()
+     * again (AVR only). Call with interrupts disabled.
+     */
+    void _reclaimCount();
+
+    /**
+     * @brief Writes new timer settings to a running timer without ever leaving the counter above the
+     * new compare value, which would make it wrap through its top (AVR only). If the prescaler changes,
+     * the count since the last match is carried over into the new prescaler's units.
+     */
+    void _applyTiming(const pulseTiming& timing);
+
+    /**
+     * @brief Starts counting matches for a postscale and sets the compare output to suit (AVR only).
+     * Postscaled, the output holds with "Set" or "Clear" and the interrupt swaps them before each edge.
+     * Otherwise it toggles on every match. A disconnected output is left disconnected.
+     * @param high true if the pin is HIGH now.
+     */
+    void _setPostscale(uint16_t postscale, bool high);
+
+    /**
+     * @brief Advances the coordinated DDA by half a major step (COORDINATED mode only).
+     */
+    void _advanceAxes();
+#else
+    /**
+     * @brief Configures and opens the FspTimer for a frequency without starting it (R4 only).
+     * The GPT divider closest to the frequency is searched for, unless sourceDiv (0, 2, ... 10) fixes it.
+     * @return true if the timer was opened, false if FspTimer failed (the error is set to TIMER_OPEN_FAILED).
+     */
+    bool _openTimer(uint32_t frequency, pulseModes mode, int8_t sourceDiv = -1);
+
+    /**
+     * @brief Reads the next entry of a play() table, moving on to the next pass at the end of one (R4 only).
+     * @return true if 'value' holds an entry, false if playback is over.
+     */
+    bool _playFetch(uint16_t& value);
+
+    /**
+     * @brief Buffers the next playback period: one entry's HIGH time followed by the next entry's LOW time (R4 only).
+     * Once the table runs out it buffers a silent period instead, and clears _pulseCounter.
+     */
+    void _loadPlaybackPeriod();
+
+    /**
+     * @brief Runs from the interrupt at the end of each DTC pass over a stream() half (R4 only). Points the
+     * DTC at the other half and refills the one just played, or hands the last pulses to the callback.
+     */
+    void _advanceStream();
+#endif
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    // --- AVR Register Access Layer ---
+    // Every hardware access made after construction goes through the register pointers
+    // bound in the constructor and these helpers, so the timer can be swapped for a model.
+    inline void _writeOcr(uint16_t value);      // Writes OCRnA using the width of the bound timer (8-bit writes never touch OCRnB).
+    inline uint16_t _readOcr() const;           // Reads OCRnA using the width of the bound timer.
+    inline uint16_t _readCounter() const;       // Reads TCNTn using the width of the bound timer.
+    inline void _writeCounter(uint16_t value);  // Writes TCNTn using the width of the bound timer.
+    inline void _setClock(uint8_t prescalerBits); // Replaces the CS bits of TCCRnB. Zero stops the timer clock.
+#endif
     
      // --- Instance Members ---
     uint8_t _pin;                         // The Arduino pin number this object controls.
@@ -181,15 +980,32 @@ private:
     bool _is_agt;                         // Flag for AGT vs GPT timer type.
     TimerPWMChannel_t _pwm_channel;       // The specific PWM channel (A or B) for the pin.
     uint8_t _timer_channel;               // The numeric channel of the timer.
+
+    /**
+     * @brief Writes the duty of the output, and of the phase output if there is one.
+     */
+    bool _setDuty(uint32_t counts);
+
+    /**
+     * @brief Sets whether the GPT pins that rise at the end of each period keep their level instead,
+     * so pause() can hold them LOW.
+     */
+    void _holdCycleEnd(bool hold);
+
+    volatile bool _resumeSkip;            // true until the overflow that resume() uses to restart the held period.
 #else
     // --- AVR Specific Members ---
     // --- Pointers to Hardware Registers ---
     // These are populated by the constructor based on the chosen pin.
     volatile uint8_t* _tccrA;             // Pointer to the Timer/Counter Control Register A (e.g., TCCR1A). Controls pin action (COM bits) and mode (WGM bits).
     volatile uint8_t* _tccrB;             // Pointer to the Timer/Counter Control Register B (e.g., TCCR1B). Controls mode (WGM bits) and clock speed (CS bits).
+    volatile uint8_t* _tccrC;             // Pointer to the register holding FOCnA (TCCRnC, or TCCR2B on Timer2). Forces the output compare latch.
     volatile uint8_t* _timsk;             // Pointer to the Timer Interrupt Mask Register (e.g., TIMSK1). Enables/disables timer-specific interrupts.
     volatile uint16_t* _ocr;              // Pointer to the Output Compare Register (e.g., OCR1A). This is the target value the timer counts to.
+    volatile uint16_t* _tcnt;             // Pointer to the Timer/Counter register (e.g., TCNT1). Accessed through _readCounter()/_writeCounter().
+    volatile uint8_t* _tifr;              // Pointer to the Timer Interrupt Flag Register (e.g., TIFR1). Used to discard stale compare flags.
     volatile uint8_t* _outputPort;        // Pointer to the physical PORTx register for this pin (e.g., PORTB). Used for forcing the pin LOW on stop.
+    volatile uint8_t* _inputPort;         // Pointer to the PINx register for this pin. Tells the interrupt which edge it follows.
 
 
     // --- Stored Configuration Bits ---
@@ -200,11 +1016,333 @@ private:
 #endif
 
     // --- State variables ---
-    volatile uint32_t _pulseCounter;      // Tracks the number of pulses/toggles generated. Must be volatile as it's modified in an ISR.
+    volatile uint32_t _pulseCounter;      // Tracks the number of pulses/toggles generated. Must be volatile as it's modified in an ISR. On AVR, toggles handed to the fast path (ptoFastCount) aren't included.
     volatile uint32_t _pulsesToGenerate;  // The target number of pulses/toggles. Volatile as it's read in an ISR.
     volatile uint8_t _pulseMode;          // The current operating mode. Volatile as it's read in an ISR.
     volatile bool _isRunning;             // The current running state. Volatile as it's modified in an ISR.
+    float _requestedFrequency;            // The frequency last asked for, for getFrequencyError(). 0 when there is none.
+
+    volatile uint16_t _counterWraps;      // Hardware counter matches still to pass before the one on the last pulse.
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    // --- Staged frequency update ---
+    pulseTiming _stagedTiming;            // The settings updateFrequency() is waiting to commit.
+    volatile bool _updatePending;         // true until the interrupt commits _stagedTiming.
+    volatile bool _hardwareCounting;      // true while the hardware counter, not the interrupt, counts the train.
+
+    // --- Software postscaler ---
+    uint16_t _postscale;                  // Compare matches per output edge. 1 when the timer reaches the frequency itself.
+    uint16_t _postscaleLeft;              // Matches until the next edge, counting the one that makes it.
+
+    uint8_t _pausedClock;                 // The prescaler bits a paused timer restarts with.
+
+    // --- Pulse width (WIDTH mode) ---
+    // updateWidth() stages a TOP and compare. The overflow buffers the compare, and ICRn, which isn't
+    // buffered, is written at the overflow after, so both start with the same period.
+    volatile uint16_t* _icr;              // Pointer to ICRn, the TOP of a WIDTH train. nullptr on Timer2.
+    uint16_t _widthStagedTop;             // The ICRn value updateWidth() is waiting to commit.
+    uint16_t _widthStagedCompare;         // The OCRnA value that goes with it.
+    uint16_t _widthNextTop;               // The ICRn value for the compare buffered at the last overflow.
+    volatile bool _widthTopPending;       // true until the overflow writes _widthNextTop.
+#endif
+
+    // --- Pause (pause() and resume()) ---
+    volatile bool _pausePending;          // true until the interrupt holds the train at its next low phase.
+    volatile bool _paused;                // true while the train is held.
+
+    // --- Segment queue ---
+    // Single producer (loop) and single consumer (ISR). Only the producer writes _queueHead and
+    // only the consumer writes _queueTail, and both are single bytes, so neither side needs a lock.
+    pulseSegment _queue[PTO_SEGMENT_QUEUE_SIZE];
+    volatile uint8_t _queueHead;          // Index of the next free slot. Written by queue().
+    volatile uint8_t _queueTail;          // Index of the oldest queued segment. Written by the ISR.
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    // --- Coordinated DDA (COORDINATED mode) ---
+    // Each major step takes two interrupts: one raises the pins of the axes that step, one lowers them.
+    // Axes sharing a port are written together, so the cost grows with the number of ports as well as axes.
+    ddaAxis _axes[PTO_MAX_AXES];
+    volatile uint8_t* _axisPorts[PTO_MAX_AXES]; // The distinct PORTx registers used by the axes.
+    uint8_t _axisRaised[PTO_MAX_AXES];    // Per port, the pins raised by the current step.
+    uint32_t _majorSteps;                 // The step count of the longest axis in the current move.
+    uint8_t _axisCount;                   // The number of axes attached with addAxis().
+    uint8_t _axisPortCount;               // The number of entries used in _axisPorts.
+    bool _axisHigh;                       // true between the raising and lowering interrupts of a step.
+
+    pulseTrainScheduler* _scheduler;      // The scheduler served by the interrupt in SCHEDULED mode.
+
+    // --- Phase outputs (OCRnB and OCRnC) ---
+    volatile uint8_t* _phaseOcr[PTO_PHASE_OUTPUTS]; // The OCRnB or OCRnC register. Only the low byte exists on Timer2.
+    volatile uint8_t* _phasePorts[PTO_PHASE_OUTPUTS]; // The PORTx register, for parking the pin LOW.
+    uint8_t _phaseMasks[PTO_PHASE_OUTPUTS]; // The bitmask for the pin within its PORT.
+    uint8_t _phaseCom[PTO_PHASE_OUTPUTS]; // The COMnx0 bit of the output. COMnx1 is the bit above.
+    uint8_t _phaseFoc[PTO_PHASE_OUTPUTS]; // The FOCnx bit of the output, in the register at _tccrC.
+#endif
+
+    uint8_t _phasePins[PTO_PHASE_OUTPUTS];// The pins added with addPhaseOutput().
+    uint16_t _phaseDegrees[PTO_PHASE_OUTPUTS]; // How far each lags the output.
+    uint8_t _phaseCount;                  // The number of phase outputs.
+    bool _phaseRunning;                   // true while the phase outputs are driven by the timer.
+
+    // --- Dithered frequency (generateMilliHz()) ---
+    volatile bool _dithering;             // true while the interrupt alternates between _ditherTop and _ditherTop + 1.
+    uint32_t _ditherTop;                  // The shorter of the two compare values (AVR OCR) or periods (R4 counts).
+    uint32_t _ditherStep;                 // The fractional count per interval, in 1/2^32 of a count.
+    uint32_t _ditherAccumulator;          // The sigma-delta accumulator. Its carry selects the longer interval.
+
+#if PTO_ENABLE_STATISTICS
+    // --- Interrupt statistics ---
+    volatile uint32_t _statsPulses;       // Rising edges seen by the interrupt.
+    volatile uint32_t _statsInterrupts;   // Interrupts taken.
+    volatile uint32_t _statsMissed;       // Interrupts that finished with the next match already due.
+    volatile uint32_t _statsDurationTotal;// The sum of the timed interrupts, in timer counts.
+    volatile uint32_t _statsTimed;        // The number of interrupts in _statsDurationTotal.
+    volatile uint16_t _statsMaxLatency;   // The longest time from a match to its interrupt, in timer counts.
+    volatile uint16_t _statsMaxDuration;  // The longest timed interrupt, in timer counts.
+    uint32_t _statsEntry;                 // The timer count when the current interrupt started.
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+    bool _statsLastHigh;                  // The pin level the last interrupt left. Toggle mode alternates it.
+#endif
+#endif
+
+    // --- Step/direction ---
+    volatile int32_t _position;           // The position before the current train. getPosition() adds its progress.
+    int8_t _direction;                    // +1 forward, -1 reverse.
+    uint8_t _directionPin;                // The pin set by setDirectionPin(), or 0xFF for none.
+    uint16_t _directionSetupUs;           // How long the direction pin must settle before a step edge.
+    volatile bool _completed;             // The completion event. Set by _finish(), cleared by pollComplete().
+    completionCallback _onComplete;       // Called by _finish(), or nullptr.
+
+    // --- Setpoint tracking (TRACKING mode) ---
+    // setTarget() writes the slot that _targetSeq doesn't point at, then flips it, so the interrupt
+    // never sees a half written target.
+    volatile uint32_t _targetSlots[2];    // The mailbox.
+    volatile uint8_t _targetSeq;          // Bumped by each setTarget(). Its low bit picks the slot.
+    uint8_t _targetSeen;                  // The last _targetSeq the interrupt took.
+    uint32_t _trackTarget;                // The target being slewed towards.
+    uint32_t _trackFrequency;             // The frequency the timer is set to.
+    uint32_t _trackStep;                  // The slew limit per period boundary, or 0 for none.
+    uint32_t _trackDeadband;              // Targets within this of _trackFrequency are ignored.
+    pulseTiming _trackTiming;             // The settings last written, so unchanged ones are skipped.
+
+    // --- Repeating bursts (BURST mode) ---
+    // The gap between bursts is split into _burstGapChunks timer periods as equal as the counts allow.
+    uint32_t _burstPulses;                // Pulses per burst.
+    uint32_t _burstsLeft;                 // Bursts still to output, counting the current one. 0 repeats forever.
+    uint32_t _burstTop;                   // The pulse timing: OCRnA on AVR, the period in counts on the R4.
+    uint32_t _burstGapChunks;             // Timer periods in the gap.
+    uint32_t _burstGapBase;               // Counts in each of them...
+    uint32_t _burstGapExtra;              // ...plus one in the first this many.
+    volatile uint32_t _burstGapLeft;      // Gap periods still to end (AVR) or start (R4). 0 during a burst.
 
+    // --- Flash table playback (PLAYBACK mode) ---
+    // On AVR the vector walks the table through ptoPlayNext. These only track the passes.
+    const uint16_t* _playTable;           // The table given to play().
+    uint16_t _playLength;                 // The number of entries in the table.
+    volatile uint16_t _playRepeats;       // Passes still to play, counting the current one. 0 loops forever.
+    volatile bool _playDone;              // Set when the final pass ends. Cleared by play().
+#if defined(ARDUINO_UNOR4_MINIMA) || defined(ARDUINO_UNOR4_WIFI)
+    uint16_t _playIndex;                  // The next entry _playFetch() reads.
+
+    // --- DTC streaming (STREAM mode) ---
+    // _dtcInfo[0] copies a period into GTPBR and chains to _dtcInfo[1], which copies its HIGH time into
+    // the duty buffer. The DTC writes both back as it goes, so _dtcInfo[0].length is what's left of the pass.
+    dtc_instance_ctrl_t _dtcCtrl;         // The FSP's DTC handle for this channel's overflow.
+    transfer_info_t _dtcInfo[2];          // The chained transfers.
+    dtc_extended_cfg_t _dtcExtend;        // Holds the overflow IRQ that triggers them.
+    transfer_cfg_t _dtcCfg;               // Points R_DTC_Open() at the two above.
+    bool _dtcOpen;                        // true while the DTC is attached to the overflow.
+    uint32_t* _streamPeriods;             // The ring given to stream().
+    uint32_t* _streamHighs;               // Its HIGH times.
+    uint16_t _streamHalf;                 // Entries in each half.
+    uint16_t _streamCounts[2];            // Entries ready in each half. 0 ends the train there.
+    uint8_t _streamPass;                  // The half the DTC is on.
+    volatile bool _streamArmed;           // true while the DTC is moving entries. Cleared for the last pulses.
+    streamRefill _streamRefill;           // Refills a played half, or nullptr once the end is known.
+#endif
+
+    // --- Planned move (MOVE mode) ---
+    // One "interval" is the time between interrupts: half a pulse on AVR, a whole pulse on the R4.
+    uint32_t _rampPeriod;                 // The current interval in timer counts, 16.16 fixed point.
+    uint32_t _rampPeriodMin;              // The interval at the cruising frequency, 16.16 fixed point.
+    uint32_t _rampPeriodMax;              // The interval at the starting frequency, 16.16 fixed point.
+    uint32_t _rampAccel;                  // The current acceleration term, a / F^2 as a mantissa scaled by 2^-(32 + _rampShift).
+    uint32_t _rampAccelPeak;              // The acceleration term at full acceleration.
+    uint32_t _rampJerkUp;                 // The acceleration term change per interval while acceleration builds.
+    uint32_t _rampJerkDown;               // The acceleration term change per interval while acceleration eases off.
+    uint32_t _rampBoundary[6];            // The interval index at which each ramp phase ends.
+    uint8_t _rampPhase;                   // The current ramp phase (0-2 accelerate, 3 cruise, 4-6 decelerate).
+    uint8_t _rampShift;                   // The binary exponent of the acceleration term.
+    uint8_t _rampScale;                   // Timer counts = interval << _rampScale. Keeps the interval within 16 bits on the R4.
+
+};
+
+/**
+ * @brief Starts, updates and stops several pulseTrainOutput objects on the same timer tick.
+ * Calling generate() on each object in turn skews them by the setup time of the ones before.
+ * A group writes every member's registers while their clocks are held, then releases them together.
+ * On AVR the prescalers are held in reset with GTCCR (TSM, PSRSYNC, PSRASY). Timer0 shares the
+ * synchronous prescaler, so each group operation can delay millis() by up to one prescaler cycle.
+ * A timer on clk/1 bypasses the prescaler and can't be held, so members run at /8 or slower. From
+ * about 122Hz (31kHz on Timer2), where generate() alone would use clk/1, a member's frequency steps
+ * are 8 times coarser, and above 1MHz it can't start (FREQUENCY_HIGH).
+ * On the R4 the members' GPT channels are started and stopped with a single GTSTR/GTSTP write,
+ * so only GPT pins can join a group.
+ */
+class pulseTrainGroup{
+  public:
+    /**
+     * @brief Construct an empty group.
+     */
+    pulseTrainGroup();
+
+    /**
+     * @brief Adds an object to the group. Members are numbered in the order they're added.
+     * @param output The object to add. It must outlive the group.
+     * @return true if the object was added.
+     * @return false if the group is full (GROUP_FULL), the pin is invalid, or (R4) the pin is on an AGT timer (INVALID_MODE).
+     */
+    bool add(pulseTrainOutput& output);
+
+    /**
+     * @brief Starts every member on the same timer tick.
+     * @param frequencies One frequency per member in Hertz, in add() order.
+     * @param mode DISCRETE or CONTINUOUS, shared by all members.
+     * @param pulses The number of HIGH pulses per member in DISCRETE mode.
+     * @return true if all members started.
+     * @return false if any member couldn't start, in which case none are started (see getError()).
+     */
+    bool generate(const uint32_t frequencies[], pulseModes mode = CONTINUOUS, uint32_t pulses = 1);
+
+    /**
+     * @brief Starts every member at the same frequency on the same timer tick.
+     */
+    bool generate(uint32_t frequency, pulseModes mode = CONTINUOUS, uint32_t pulses = 1);
+
+    /**
+     * @brief Changes the frequency of every running member while their clocks are held, so the
+     * members keep their phase relationship. A counter already past its new compare value ends
+     * its current half period straight away rather than wrapping.
+     * @param frequencies One frequency per member in Hertz, in add() order.
+     * @return true if all members were updated.
+     * @return false if a member isn't running or a frequency is out of range. Nothing is changed.
+     */
+    bool updateFrequency(const uint32_t frequencies[]);
+
+    /**
+     * @brief Stops every member on the same timer tick.
+     */
+    void stop();
+
+    /**
+     * @brief Returns the start offset of a member relative to the first one, measured by the last
+     * generate(). Each counter is sampled twice, in forward then reverse order, so all members are
+     * compared at the same instant. Zero means the members started on the same clock.
+     * The resolution is the member's prescaler.
+     * @param index The member, in add() order.
+     * @return The offset in CPU cycles (AVR) or timer source clock cycles (R4), or PTO_SKEW_UNKNOWN
+     * if a member's first half period was too short to sample.
+     */
+    int32_t getSkew(uint8_t index) const;
+
+    /**
+     * @brief Checks if there was an error with the last group operation.
+     * @return Returns the error of the member that failed, or GROUP_FULL if add() found the group full.
+     */
+    uint8_t getError() const;
+
+  private:
+    /**
+     * @brief Samples every member's counter just after a start and fills in _skew.
+     * Must be called with interrupts disabled.
+     */
+    void _measureSkew();
+
+    pulseTrainOutput* _members[PTO_GROUP_SIZE]; // The members, in add() order.
+    int32_t _skew[PTO_GROUP_SIZE];        // The start offset of each member from the last generate().
+    uint8_t _count;                       // The number of members.
+    uint8_t _error;                       // Holds the most recent error.
+};
+
+/**
+ * @brief Runs up to PTO_MAX_VIRTUAL square waves ("virtual channels") on any digital pins from the
+ * compare interrupt of one timer (AVR only). The next edge of every channel is kept in a min-heap,
+ * the compare is set for the earliest, and the interrupt toggles every pin that is due. Edges are
+ * timed by software, so they carry the interrupt's latency and jitter (see the README for limits).
+ */
+class pulseTrainScheduler{
+    friend class pulseTrainOutput;        // Its interrupt calls _service().
+  public:
+    /**
+     * @brief Construct a scheduler that borrows the timer of an existing object. The object's own pin
+     * isn't driven while channels run.
+     * @param timer The object whose timer clocks the channels. It must outlive the scheduler.
+     */
+    pulseTrainScheduler(pulseTrainOutput& timer);
+
+    /**
+     * @brief Adds a virtual channel on any digital pin and drives it LOW.
+     * @param pin The Arduino pin number.
+     * @return false if the scheduler is full (SCHEDULER_FULL), the pin is invalid or already added,
+     * or the timer's pin is invalid (INVALID_PIN), or on the R4 (INVALID_MODE).
+     */
+    bool add(uint8_t pin);
+
+    /**
+     * @brief Starts a square wave on a channel. The first rising edge is half a period after the call.
+     * Other channels keep running undisturbed.
+     * @param pin A pin given to add().
+     * @param frequency The frequency in Hertz.
+     * @param mode DISCRETE or CONTINUOUS.
+     * @param pulses The number of HIGH pulses in DISCRETE mode.
+     * @return false if the pin wasn't added (INVALID_PIN), the channel is running or the timer is in use
+     * by something else (ACTIVE), or the frequency, mode or pulse count is invalid.
+     */
+    bool generate(uint8_t pin, uint32_t frequency, pulseModes mode = CONTINUOUS, uint32_t pulses = 1);
+
+    /**
+     * @brief Stops one channel and drives it LOW. The timer stops with the last channel.
+     */
+    void stop(uint8_t pin);
+
+    /**
+     * @brief Stops every channel and the timer.
+     */
+    void stop();
+
+    /**
+     * @brief Checks if a channel is running. A DISCRETE channel stops by itself after its last pulse.
+     */
+    bool isRunning(uint8_t pin) const;
+
+    /**
+     * @brief Checks if there was an error with the last operation.
+     */
+    uint8_t getError() const;
+
+  private:
+    /**
+     * @brief Called by the timer's compare interrupt. Toggles every channel that is due, reschedules
+     * them, and sets the compare for the next edge.
+     */
+    void _service();
+
+    uint8_t _find(uint8_t pin) const;     // Returns the channel with this pin, or _count if none.
+    void _push(uint8_t channel);          // Adds an idle channel to the heap.
+    void _remove(uint8_t channel);        // Takes a channel out of the heap.
+    void _siftUp(uint8_t slot);
+    void _siftDown(uint8_t slot);
+
+    pulseTrainOutput* _timer;             // The object whose timer clocks the channels.
+    virtualChannel _channels[PTO_MAX_VIRTUAL]; // The channels, in add() order.
+    uint8_t _heap[PTO_MAX_VIRTUAL];       // Running channels, ordered as a min-heap by their next edge.
+    uint8_t _heapSize;                    // The number of running channels.
+    uint8_t _count;                       // The number of channels added.
+    uint32_t _now;                        // The timer count of the last compare match, on the running clock.
+    uint32_t _interval;                   // The counts from _now to the match the compare is set for.
+    uint16_t _batchTicks;                 // PTO_VIRTUAL_BATCH_US in timer counts.
+    uint16_t _marginTicks;                // Counts that may pass between reading TCNT and writing OCR.
+    uint8_t _error;                       // Holds the most recent error.
 };
 
-#endif // JCT_PULSETRAINOUTPUT_H
\ No newline at end of file
+#endif // JCT_PULSETRAINOUTPUT_H
@@ -0,0 +1,270 @@
+/**
+ * @file pulseTrainTimer.h
+ * @author Costello Technical
+ * @brief Compile-time pin binding for the jct_pulseTrainOutput library (AVR only).
+ * pulseTrainTimer<PIN> resolves the timer, its registers and bit masks from the pin number at
+ * compile time. Its state is static, so an object takes no RAM, and its interrupt handler is
+ * inlined into the vector with fixed register addresses instead of going through
+ * pulseTrainOutput::_instances[] and the pointers stored in each object.
+ * @see https://github.com/CostelloTechnical/pulseTrainOutput/blob/main/README.md
+ *
+ * Usage:
+ *   pulseTrainTimer<9> output;
+ *   PTO_TIMER_ISR(9)
+ *
+ * PTO_TIMER_ISR() replaces the library's own compare vector for that timer, so a pulseTrainTimer
+ * and a pulseTrainOutput must not share a timer.
+ */
+#ifndef PULSETRAINTIMER_H
+#define PULSETRAINTIMER_H
+#include "pulseTrainOutput.h"
+
+#if !defined(ARDUINO_UNOR4_MINIMA) && !defined(ARDUINO_UNOR4_WIFI)
+
+/**
+ * @brief Register and bit mask traits for one output pin. Only the pins in the hardware
+ * support table have a specialization; any other pin fails to compile.
+ */
+template <uint8_t PIN>
+struct pulseTrainPin {
+    static_assert(PIN != PIN, "pulseTrainTimer: this pin has no supported timer output on this board.");
+};
+
+// A 16-bit timer's channel A output: timer number, then the port letter and bit of its OCnA pin.
+#define PTO_TIMER16_PIN(pin, n, port, bit)                                              \
+    template <> struct pulseTrainPin<pin> {                                             \
+        static const bool is16bit = true;                                               \
+        static const uint8_t ocie = _BV(OCIE##n##A);                                    \
+        static const uint8_t comToggle = _BV(COM##n##A0);                               \
+        static const uint8_t comClear = _BV(COM##n##A1);                                \
+        static const uint8_t wgmA = 0;                                                  \
+        static const uint8_t wgmB = _BV(WGM##n##2);                                     \
+        static const uint8_t foc = _BV(FOC##n##A);                                      \
+        static const uint8_t pinMask = _BV(P##port##bit);                               \
+        static volatile uint8_t& tccrA() { return TCCR##n##A; }                         \
+        static volatile uint8_t& tccrB() { return TCCR##n##B; }                         \
+        static volatile uint8_t& tccrFoc() { return TCCR##n##C; }                       \
+        static volatile uint8_t& timsk() { return TIMSK##n; }                           \
+        static volatile uint8_t& tifr() { return TIFR##n; }                             \
+        static volatile uint8_t& outputPort() { return PORT##port; }                    \
+        static volatile uint8_t& inputPort() { return PIN##port; }                      \
+        static uint16_t readCounter() { PTO_MODEL_READ(&TCNT##n); return TCNT##n; }     \
+        static void writeCounter(uint16_t value) {                                      \
+            TCNT##n = value;                                                            \
+            PTO_MODEL_WRITE(&TCNT##n);                                                  \
+        }                                                                               \
+        static void writeOcr(uint16_t value) { OCR##n##A = value; }                     \
+    };
+
+// Timer2's channel A output. It keeps WGM21 in TCCR2A and FOC2A in TCCR2B.
+#define PTO_TIMER2_PIN(pin, port, bit)                                                  \
+    template <> struct pulseTrainPin<pin> {                                             \
+        static const bool is16bit = false;                                              \
+        static const uint8_t ocie = _BV(OCIE2A);                                        \
+        static const uint8_t comToggle = _BV(COM2A0);                                   \
+        static const uint8_t comClear = _BV(COM2A1);                                    \
+        static const uint8_t wgmA = _BV(WGM21);                                         \
+        static const uint8_t wgmB = 0;                                                  \
+        static const uint8_t foc = _BV(FOC2A);                                          \
+        static const uint8_t pinMask = _BV(P##port##bit);                               \
+        static volatile uint8_t& tccrA() { return TCCR2A; }                             \
+        static volatile uint8_t& tccrB() { return TCCR2B; }                             \
+        static volatile uint8_t& tccrFoc() { return TCCR2B; }                           \
+        static volatile uint8_t& timsk() { return TIMSK2; }                             \
+        static volatile uint8_t& tifr() { return TIFR2; }                               \
+        static volatile uint8_t& outputPort() { return PORT##port; }                    \
+        static volatile uint8_t& inputPort() { return PIN##port; }                      \
+        static uint16_t readCounter() { PTO_MODEL_READ(&TCNT2); return TCNT2; }         \
+        static void writeCounter(uint16_t value) {                                      \
+            TCNT2 = value;                                                              \
+            PTO_MODEL_WRITE(&TCNT2);                                                    \
+        }                                                                               \
+        static void writeOcr(uint16_t value) { OCR2A = value; }                         \
+    };
+
+// The traits for each supported pin, and its timer's compare vector for PTO_TIMER_ISR().
+#if defined(__AVR_ATmega2560__)
+PTO_TIMER16_PIN(11, 1, B, 5)
+PTO_TIMER2_PIN(10, B, 4)
+PTO_TIMER16_PIN(5, 3, E, 3)
+PTO_TIMER16_PIN(6, 4, H, 3)
+PTO_TIMER16_PIN(46, 5, L, 3)
+#define PTO_VECTOR_11 TIMER1_COMPA_vect
+#define PTO_VECTOR_10 TIMER2_COMPA_vect
+#define PTO_VECTOR_5 TIMER3_COMPA_vect
+#define PTO_VECTOR_6 TIMER4_COMPA_vect
+#define PTO_VECTOR_46 TIMER5_COMPA_vect
+#else // Arduino Uno, Nano, etc.
+PTO_TIMER16_PIN(9, 1, B, 1)
+PTO_TIMER2_PIN(11, B, 3)
+#define PTO_VECTOR_9 TIMER1_COMPA_vect
+#define PTO_VECTOR_11 TIMER2_COMPA_vect
+#endif
+
+/**
+ * @brief Binds a pulseTrainTimer to its timer's compare vector. Use once per pin, at file scope.
+ * An unsupported pin fails to compile here as well.
+ */
+#define PTO_TIMER_ISR(pin) ISR(PTO_VECTOR_##pin) { pulseTrainTimer<pin>::handleInterrupt(); }
+
+/**
+ * @brief A pulse train on a pin fixed at compile time. Supports DISCRETE and CONTINUOUS trains
+ * and updateFrequency() with the same period boundary behaviour as pulseTrainOutput.
+ * Queues, moves, dithering and the hardware counter stay with pulseTrainOutput.
+ */
+template <uint8_t PIN>
+class pulseTrainTimer {
+    typedef pulseTrainPin<PIN> hw;
+    static_assert(sizeof(hw) > 0, "Instantiates the pin traits so an unsupported pin is caught here.");
+public:
+    /**
+     * @brief Sets the pin up as an output. All state is static, so every object for a pin is the same train.
+     */
+    pulseTrainTimer() {
+        pinMode(PIN, OUTPUT);
+    }
+
+    /**
+     * @brief Starts a pulse train. See pulseTrainOutput::generate().
+     * @return true if the train started, false with the error set otherwise.
+     */
+    static bool generate(uint32_t frequency, pulseModes mode = CONTINUOUS, uint32_t pulses = 1) {
+        if (_isRunning) {
+            _error = ACTIVE;
+            return false;
+        }
+        if (frequency == 0) {
+            _error = ZERO_HZ;
+            return false;
+        }
+        if (mode != DISCRETE && mode != CONTINUOUS) {
+            _error = INVALID_MODE;
+            return false;
+        }
+        if (pulses == 0 && mode == DISCRETE) {
+            _error = ZERO_PULSES;
+            return false;
+        }
+        pulseTiming timing;
+        if (!avrSolveTiming(hw::is16bit, frequency, timing)) {
+            _error = FREQUENCY_HIGH;
+            return false;
+        }
+        _error = NO_ERROR;
+        _pulseMode = mode;
+        _pulseCounter = pulses * 2;
+        _updatePending = false;
+
+        uint8_t oldSREG = SREG;
+        cli();
+        hw::tccrA() = 0;
+        hw::tccrB() = 0;
+        hw::writeOcr(timing.top);
+        hw::writeCounter(0);
+        hw::tifr() = hw::ocie;                // OCFnA shares its bit position with OCIEnA.
+        PTO_MODEL_WRITE(&hw::tifr());
+        hw::tccrA() = hw::comToggle | hw::wgmA;
+        hw::tccrB() = hw::wgmB | timing.prescalerBits;
+        if (mode == DISCRETE) {
+            hw::timsk() |= hw::ocie;
+        }
+        _isRunning = true;
+        SREG = oldSREG;
+        return true;
+    }
+
+    /**
+     * @brief Changes the frequency at the start of the next HIGH half. See pulseTrainOutput::updateFrequency().
+     * @return false if the timer is not running or the frequency is out of range.
+     */
+    static bool updateFrequency(uint32_t newFrequency) {
+        if (!_isRunning) {
+            return false;
+        }
+        pulseTiming timing;
+        if (!avrSolveTiming(hw::is16bit, newFrequency, timing)) {
+            _error = FREQUENCY_HIGH;
+            return false;
+        }
+        uint8_t oldSREG = SREG;
+        cli();
+        _stagedTiming = timing;
+        _updatePending = true;
+        if (!(hw::timsk() & hw::ocie)) {
+            hw::tifr() = hw::ocie;            // Wait for a real boundary, not a match from earlier.
+            PTO_MODEL_WRITE(&hw::tifr());
+            hw::timsk() |= hw::ocie;
+        }
+        SREG = oldSREG;
+        return true;
+    }
+
+    /**
+     * @brief Immediately stops the pulse train and forces the pin LOW.
+     */
+    static void stop() {
+        hw::tccrA() = (hw::tccrA() & ~(hw::comToggle | hw::comClear)) | hw::comClear;
+        hw::tccrFoc() |= hw::foc;             // Park the compare latch LOW so the next train starts with a rise.
+        hw::tccrA() &= ~(hw::comToggle | hw::comClear);
+        hw::outputPort() &= ~hw::pinMask;
+        hw::tccrB() &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10));
+        hw::timsk() &= ~hw::ocie;
+        _updatePending = false;
+        _isRunning = false;
+    }
+
+    static bool isRunning() { return _isRunning; }
+    static uint8_t getError() { return _error; }
+
+    /**
+     * @brief The compare match handler. PTO_TIMER_ISR() inlines it into the vector.
+     */
+    static inline __attribute__((always_inline)) void handleInterrupt() {
+        if (_updatePending && (hw::inputPort() & hw::pinMask)) {
+            // A HIGH half has just started. The counter cleared a few ticks ago, so restarting it
+            // loses no more than the interrupt latency when the prescaler changes.
+            _updatePending = false;
+            uint8_t bits = _stagedTiming.prescalerBits;
+            uint16_t top = _stagedTiming.top;
+            uint8_t control = hw::tccrB();
+            if ((control & (_BV(CS12) | _BV(CS11) | _BV(CS10))) != bits || hw::readCounter() >= top) {
+                hw::tccrB() = control & ~(_BV(CS12) | _BV(CS11) | _BV(CS10));
+                hw::writeCounter(0);
+                hw::writeOcr(top);
+                hw::tccrB() = (control & ~(_BV(CS12) | _BV(CS11) | _BV(CS10))) | bits;
+            } else {
+                hw::writeOcr(top);
+            }
+        }
+        if (_pulseMode == DISCRETE) {
+            uint32_t remaining = _pulseCounter - 1;
+            _pulseCounter = remaining;
+            if (remaining == 1) {
+                // The rising edge of the last pulse: clear rather than toggle on the next match.
+                hw::tccrA() = (hw::tccrA() & ~(hw::comToggle | hw::comClear)) | hw::comClear;
+            } else if (remaining == 0) {
+                stop();
+            }
+        } else if (!_updatePending) {
+            hw::timsk() &= ~hw::ocie;         // The interrupt was only enabled to commit an update.
+        }
+    }
+
+private:
+    static volatile uint32_t _pulseCounter;   // Toggles left in a DISCRETE train.
+    static volatile uint8_t _pulseMode;       // DISCRETE or CONTINUOUS.
+    static volatile bool _isRunning;          // The current running state.
+    static volatile bool _updatePending;      // true until the interrupt commits _stagedTiming.
+    static pulseTiming _stagedTiming;         // The settings updateFrequency() is waiting to commit.
+    static uint8_t _error;                    // Holds the most recent error.
+};
+
+template <uint8_t PIN> volatile uint32_t pulseTrainTimer<PIN>::_pulseCounter = 0;
+template <uint8_t PIN> volatile uint8_t pulseTrainTimer<PIN>::_pulseMode = STOP;
+template <uint8_t PIN> volatile bool pulseTrainTimer<PIN>::_isRunning = false;
+template <uint8_t PIN> volatile bool pulseTrainTimer<PIN>::_updatePending = false;
+template <uint8_t PIN> pulseTiming pulseTrainTimer<PIN>::_stagedTiming;
+template <uint8_t PIN> uint8_t pulseTrainTimer<PIN>::_error = NO_ERROR;
+
+#endif
+#endif // PULSETRAINTIMER_H